@@ -0,0 +1,33 @@
+#include "n_tuple_TD.hpp"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+/*
+ * Usage: Analyze.exe <weights (.pkl text or .bin image)> [epsilon] [tile_radix output.bin]
+ * Reports table occupancy; with tile_radix and an output path it also writes
+ * a compacted binary image (entries within epsilon of init_value pruned).
+ */
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <weights> [epsilon] [tile_radix output.bin]\n";
+        return 1;
+    }
+    std::vector<Pattern> patterns = default_patterns();
+    NTupleTD agent(patterns);
+
+    const std::string path = argv[1];
+    const double epsilon = (argc > 2) ? std::atof(argv[2]) : 0.0;
+    if (path.size() > 4 && path.substr(path.size() - 4) == ".bin")
+        agent.attach_weights(path, "");
+    else
+        agent.load_weights(path);
+
+    agent.analyze_weights(epsilon);
+    if (argc > 4) {
+        agent.compact_weights(epsilon, std::atoi(argv[3]));
+        agent.save_weights_image(argv[4]);
+    }
+    return 0;
+}
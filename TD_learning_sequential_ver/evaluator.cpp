@@ -0,0 +1,161 @@
+#include "evaluator.hpp"
+#include <iostream>
+#include <fstream>
+#include <limits>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+static const int EVAL_FIRST_TILE_EXPONENT = 11;    // 2048
+
+// The snapshot scores moves by r + V, undiscounted, like the players it replaced
+CheckpointEvaluator::CheckpointEvaluator(std::vector<Pattern>& patterns, const int greedy_games, const int expectimax_games,
+                                         const unsigned int seed, const std::string& path)
+    : snapshot(patterns, 4, 4, 0.0, 0.01, 1.0), greedy_games(greedy_games), expectimax_games(expectimax_games), seed(seed), path(path), busy(false)
+{
+}
+
+CheckpointEvaluator::~CheckpointEvaluator()
+{
+    wait();
+}
+
+void CheckpointEvaluator::wait()
+{
+    if (worker.joinable())
+        worker.join();
+    return;
+}
+
+/*
+ * Freezes the agent's current weights and evaluates them in the background.
+ * Only the copy runs on the caller's thread. The evaluator is claimed before
+ * anything is copied: if the previous checkpoint is still being evaluated,
+ * returns false and the tables are not touched.
+ */
+bool CheckpointEvaluator::submit(const NTupleTD& agent, const int episode)
+{
+    if (busy.exchange(true))
+        return false;
+    wait();
+    snapshot.copy_weights(agent);
+    worker = std::thread(&CheckpointEvaluator::evaluate, this, episode);
+    return true;
+}
+
+void CheckpointEvaluator::evaluate(const int episode)
+{
+    // Yield the CPU to the training thread when no core is spare
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+
+    const EvalResult results[2] = {play_games(greedy_games, false), play_games(expectimax_games, true)};
+    const char* players[2] = {"greedy", "expectimax"};
+
+    std::ifstream existing(path);
+    const bool has_header = existing.peek() != std::ifstream::traits_type::eof();
+    existing.close();
+    std::ofstream ofs(path, std::ios_base::app);
+    if (!ofs.is_open()) {
+        std::cerr << "Error opening file for saving evaluation: " << path << "\n";
+        busy.store(false);
+        return;
+    }
+    if (!has_header)
+        ofs << "# episode player games mean_score rate_2048 rate_4096 rate_8192 rate_16384 rate_32768\n";
+    for (int p = 0; p < 2; p++) {
+        if (results[p].games == 0) continue;
+        ofs << episode << " " << players[p] << " " << results[p].games << " " << results[p].mean_score;
+        for (int level = 0; level < EVAL_TILE_LEVELS; level++)
+            ofs << " " << results[p].tile_rates[level];
+        ofs << "\n";
+    }
+    ofs.close();
+    std::cout << "Checkpoint " << episode << " evaluated: greedy " << results[0].mean_score
+              << ", expectimax " << results[1].mean_score << "\n";
+    busy.store(false);
+    return;
+}
+
+// Game g always uses seed + g, so every checkpoint is measured on the same tile sequences
+EvalResult CheckpointEvaluator::play_games(const int games, const bool expectimax) const
+{
+    EvalResult result = {games, 0.0, {0, 0, 0, 0, 0}};
+    for (int game = 0; game < games; game++) {
+        std::mt19937 rng(seed + game);
+        int max_exponent = 0;
+        result.mean_score += play_game(rng, expectimax, max_exponent);
+        for (int level = 0; level < EVAL_TILE_LEVELS; level++)
+            if (max_exponent >= EVAL_FIRST_TILE_EXPONENT + level)
+                result.tile_rates[level]++;
+    }
+    if (games > 0) {
+        result.mean_score /= games;
+        for (int level = 0; level < EVAL_TILE_LEVELS; level++)
+            result.tile_rates[level] /= games;
+    }
+    return result;
+}
+
+static BitBoard add_random_tile(const BitBoard board, std::mt19937& rng)
+{
+    int empty[BITBOARD_CELLS], n_empty = 0;
+    for (int cell = 0; cell < BITBOARD_CELLS; cell++)
+        if (bitboard_exponent(board, cell) == 0)
+            empty[n_empty++] = cell;
+    if (n_empty == 0)
+        return board;
+    const int cell = empty[rng() % n_empty];
+    const BitBoard exponent = (rng() % 10 == 0) ? 2 : 1;
+    return board | (exponent << (4 * cell));
+}
+
+// Plays until no move is legal, or until a 32768 tile leaves the range of BitBoard
+int CheckpointEvaluator::play_game(std::mt19937& rng, const bool expectimax, int& max_exponent) const
+{
+    BitBoard board = add_random_tile(add_random_tile(0, rng), rng);
+    int score = 0;
+    max_exponent = 0;
+    while (max_exponent <= BITBOARD_MAX_EXPONENT) {
+        const int action = expectimax ? expectimax_action(board) : snapshot.choose_action(board, 0);
+        if (action == -1)
+            break;
+        BitBoard afterstate;
+        score += bitboard_move(board, action, afterstate);
+        board = add_random_tile(afterstate, rng);
+        for (int cell = 0; cell < BITBOARD_CELLS; cell++)
+            max_exponent = std::max(max_exponent, bitboard_exponent(board, cell));
+    }
+    return score;
+}
+
+// Move, every tile spawn (2 with 0.9, 4 with 0.1), then the greedy move on each outcome
+int CheckpointEvaluator::expectimax_action(const BitBoard board) const
+{
+    BitBoard afterstates[4];
+    int rewards[4];
+    const int legal = bitboard_afterstates(board, afterstates, rewards);
+    int best_action = -1;
+    double best_value = -std::numeric_limits<double>::infinity();
+    for (int action = 0; action < 4; action++) {
+        if (!((legal >> action) & 1))
+            continue;
+        double expected = 0;
+        int n_empty = 0;
+        for (int cell = 0; cell < BITBOARD_CELLS; cell++) {
+            if (bitboard_exponent(afterstates[action], cell) != 0)
+                continue;
+            double value_2, value_4;
+            snapshot.choose_action(afterstates[action] | (BitBoard(1) << (4 * cell)), 0, &value_2);
+            snapshot.choose_action(afterstates[action] | (BitBoard(2) << (4 * cell)), 0, &value_4);
+            expected += 0.9 * value_2 + 0.1 * value_4;
+            n_empty++;
+        }
+        const double value = rewards[action] + (n_empty > 0 ? expected / n_empty : 0);
+        if (value > best_value) {
+            best_value = value;
+            best_action = action;
+        }
+    }
+    return best_action;
+}
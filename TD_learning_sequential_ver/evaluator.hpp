@@ -0,0 +1,50 @@
+#ifndef EVALUATOR_HPP
+#define EVALUATOR_HPP
+
+#include "n_tuple_TD.hpp"
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+
+#define EVAL_TILE_LEVELS 5      // Tile rates reported from 2048 up to 32768
+
+typedef struct {
+    int games;
+    double mean_score;
+    double tile_rates[EVAL_TILE_LEVELS];
+} EvalResult;
+
+/*
+ * Plays fixed-seed evaluation games on a frozen snapshot of the weights in a
+ * background thread, so a checkpoint can be measured while training goes on.
+ * Games run on BitBoard with their own generator: the training thread's rand()
+ * stream is left alone. A checkpoint submitted while the previous one is still
+ * being evaluated is skipped rather than queued, so training never waits.
+ * Results are appended to path, one line per checkpoint and player.
+ */
+class CheckpointEvaluator
+{
+    private:
+        NTupleTD snapshot;
+        int greedy_games;
+        int expectimax_games;
+        unsigned int seed;
+        std::string path;
+        std::thread worker;
+        std::atomic<bool> busy;
+
+        void evaluate(const int episode);
+        EvalResult play_games(const int games, const bool expectimax) const;
+        int play_game(std::mt19937& rng, const bool expectimax, int& max_exponent) const;
+        int expectimax_action(const BitBoard board) const;
+
+    public:
+        CheckpointEvaluator(std::vector<Pattern>& patterns, const int greedy_games = 100, const int expectimax_games = 10,
+                            const unsigned int seed = 2048, const std::string& path = "2048_eval.txt");
+        ~CheckpointEvaluator();
+        bool submit(const NTupleTD& agent, const int episode);
+        void wait();
+};
+
+#endif
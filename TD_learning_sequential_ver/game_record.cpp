@@ -0,0 +1,139 @@
+#include "game_record.hpp"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+GameRecorder::GameRecorder(const std::string& path)
+    : path(path)
+{
+}
+
+// The reward of a move belongs to the step of the previous afterstate
+void GameRecorder::add_move(const BitBoard afterstate, const int reward)
+{
+    if (!game.empty())
+        game.back().reward = reward;
+    game.push_back({afterstate, 0, false, false, 0});
+    return;
+}
+
+// Marks the last afterstate terminal and appends the game to the file
+void GameRecorder::end_game()
+{
+    if (game.empty())
+        return;
+    game.back().done = true;
+    append_game();
+    return;
+}
+
+// Appends a game that is still going on, e.g. once its tiles leave the BitBoard range
+void GameRecorder::truncate_game()
+{
+    if (game.empty())
+        return;
+    game.back().truncated = true;
+    append_game();
+    return;
+}
+
+/*
+ * Many players may append to one file, so the whole read header / write
+ * steps / write header sequence holds an exclusive lock on it; the header is
+ * rewritten last, so a reader never counts steps that are not there yet.
+ */
+void GameRecorder::append_game()
+{
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || flock(fd, LOCK_EX) != 0) {
+        std::cerr << "Error opening file for recording games: " << path << "\n";
+        if (fd >= 0)
+            close(fd);
+        game.clear();
+        return;
+    }
+    GameRecordHeader header;
+    const ssize_t header_bytes = pread(fd, &header, sizeof(header), 0);
+    if (header_bytes <= 0) {
+        std::memcpy(header.magic, GAME_RECORD_MAGIC, sizeof(header.magic));
+        header.n_steps = 0;
+    }
+    else if (header_bytes != sizeof(header) || std::memcmp(header.magic, GAME_RECORD_MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << "Not a game record: " << path << "\n";
+        close(fd);
+        game.clear();
+        return;
+    }
+    const size_t bytes = game.size() * sizeof(PackedStep);
+    if (pwrite(fd, game.data(), bytes, sizeof(header) + header.n_steps * sizeof(PackedStep)) != static_cast<ssize_t>(bytes))
+        std::cerr << "Error recording game: " << path << "\n";
+    else {
+        header.n_steps += game.size();
+        if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+            std::cerr << "Error recording game: " << path << "\n";
+    }
+    close(fd);
+    game.clear();
+    return;
+}
+
+GameDataset::GameDataset()
+    : mapping(nullptr), mapping_bytes(0), steps(nullptr), n_steps(0)
+{
+}
+
+GameDataset::~GameDataset()
+{
+    if (mapping != nullptr)
+        munmap(mapping, mapping_bytes);
+}
+
+bool GameDataset::open(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error opening game record: " << path << "\n";
+        return false;
+    }
+    struct stat st;
+    GameRecordHeader header;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(header)
+     || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+     || std::memcmp(header.magic, GAME_RECORD_MAGIC, sizeof(header.magic)) != 0
+     || st.st_size < sizeof(header) + header.n_steps * sizeof(PackedStep)) {
+        std::cerr << "Not a game record or truncated: " << path << "\n";
+        close(fd);
+        return false;
+    }
+    const size_t bytes = sizeof(header) + header.n_steps * sizeof(PackedStep);
+    void* region = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        std::cerr << "Error mapping game record: " << path << "\n";
+        return false;
+    }
+    if (mapping != nullptr)
+        munmap(mapping, mapping_bytes);
+    mapping = region;
+    mapping_bytes = bytes;
+    steps = reinterpret_cast<const PackedStep*>(static_cast<char*>(region) + sizeof(header));
+    n_steps = header.n_steps;
+    return true;
+}
+
+// Asks the kernel to read a block ahead while the previous one is being trained on
+void GameDataset::prefetch(const size_t start, const size_t count) const
+{
+    if (start >= n_steps)
+        return;
+    const size_t page = 4096;
+    const size_t first = (sizeof(GameRecordHeader) + start * sizeof(PackedStep)) / page * page;
+    const size_t last = sizeof(GameRecordHeader) + std::min(start + count, n_steps) * sizeof(PackedStep);
+    madvise(static_cast<char*>(mapping) + first, last - first, MADV_WILLNEED);
+    return;
+}
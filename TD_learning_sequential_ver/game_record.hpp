@@ -0,0 +1,60 @@
+#ifndef GAME_RECORD_HPP
+#define GAME_RECORD_HPP
+
+#include "n_tuple_TD.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define GAME_RECORD_MAGIC "NTUPLEG2"
+
+/*
+ * Recorded games: header, then PackedStep records, game after game. Step t of
+ * a game holds the afterstate of move t, the reward of move t + 1 and whether
+ * the game ended there, the same layout train() sweeps over, so a TD target
+ * is reward + V(next step) unless done. A game the player stopped recording
+ * ends on a truncated step instead, which has no target at all.
+ */
+typedef struct {
+    char magic[8];
+    uint64_t n_steps;
+} GameRecordHeader;
+
+// Appends games played by any player (e.g. expectimax) to a record file
+class GameRecorder
+{
+    private:
+        std::string path;
+        std::vector<PackedStep> game;
+
+        void append_game();
+
+    public:
+        GameRecorder(const std::string& path);
+        void add_move(const BitBoard afterstate, const int reward);
+        void end_game();
+        void truncate_game();
+};
+
+// Read-only mapping of a record file; steps are paged in as they are read
+class GameDataset
+{
+    private:
+        void* mapping;
+        size_t mapping_bytes;
+        const PackedStep* steps;
+        size_t n_steps;
+
+    public:
+        GameDataset();
+        ~GameDataset();
+        GameDataset(const GameDataset&) = delete;
+        GameDataset& operator=(const GameDataset&) = delete;
+
+        bool open(const std::string& path);
+        void prefetch(const size_t start, const size_t count) const;
+        size_t size() const { return n_steps; }
+        const PackedStep& operator[](const size_t index) const { return steps[index]; }
+};
+
+#endif
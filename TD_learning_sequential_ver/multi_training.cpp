@@ -0,0 +1,209 @@
+#include "n_tuple_TD.hpp"
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <numeric>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define MAX_WORKERS 64
+
+/*
+ * Control block at the start of the shared segment. Worker k trains on its own
+ * table (slot k of the segment) for one round, records its scores, publishes
+ * arrived[k] = generation + 1 and waits for the generation to move on. The
+ * supervisor then averages the tables of the workers that arrived, writes the
+ * mean back to every slot, checkpoints and bumps the generation.
+ */
+typedef struct {
+    std::atomic<uint64_t> generation;
+    std::atomic<int> stop;
+    std::atomic<uint64_t> arrived[MAX_WORKERS];
+    std::atomic<int> n_scores[MAX_WORKERS];
+} SharedControl;
+
+typedef struct {
+    SharedControl* control;
+    Weight* tables;             // n_workers tables of n_weights entries
+    int* scores;                // n_workers * round_episodes game scores of the last round
+    size_t n_weights;
+    int n_workers;
+    int round_episodes;
+} SharedSegment;
+
+static Weight* slot_table(const SharedSegment& segment, const int slot)
+{
+    return segment.tables + slot * segment.n_weights;
+}
+
+static void wait_generation(const SharedSegment& segment, const uint64_t generation)
+{
+    while (segment.control->generation.load() == generation && !segment.control->stop.load())
+        usleep(1000);
+    return;
+}
+
+/*
+ * Body of a worker process. A respawned worker first waits for the next
+ * generation, whose averaged table overwrites whatever its crashed predecessor
+ * left half-written in the slot.
+ */
+static void run_worker(NTupleTD& agent, const SharedSegment& segment, const int slot, const double epsilon, const bool respawned)
+{
+    Env2048 env;
+    srand(static_cast<unsigned int>(time(nullptr)) ^ (getpid() << 16));
+    agent.bind_weights(slot_table(segment, slot));
+    agent.set_checkpointing(false);
+
+    uint64_t generation = segment.control->generation.load();
+    if (respawned) {
+        segment.control->n_scores[slot].store(0);
+        segment.control->arrived[slot].store(generation + 1);
+        wait_generation(segment, generation);
+    }
+    while (!segment.control->stop.load()) {
+        generation = segment.control->generation.load();
+        std::vector<int> scores = agent.train(env, segment.round_episodes, epsilon);
+        std::copy(scores.begin(), scores.end(), segment.scores + slot * segment.round_episodes);
+        segment.control->n_scores[slot].store(scores.size());
+        segment.control->arrived[slot].store(generation + 1);
+        wait_generation(segment, generation);
+    }
+    return;
+}
+
+static pid_t spawn_worker(NTupleTD& agent, const SharedSegment& segment, const int slot, const double epsilon, const bool respawned)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        run_worker(agent, segment, slot, epsilon, respawned);
+        _exit(0);
+    }
+    if (pid < 0)
+        std::cerr << "Error forking worker " << slot << "\n";
+    return pid;
+}
+
+// Mean of the tables of the slots that completed the round, written back to every slot
+static void average_tables(const SharedSegment& segment, const std::vector<bool>& valid)
+{
+    const int n_valid = std::count(valid.begin(), valid.end(), true);
+    if (n_valid == 0)
+        return;
+    const size_t chunk = 4096;
+    for (size_t start = 0; start < segment.n_weights; start += chunk) {
+        const size_t end = std::min(start + chunk, segment.n_weights);
+        for (size_t index = start; index < end; index++) {
+            double sum = 0;
+            for (int slot = 0; slot < segment.n_workers; slot++)
+                if (valid[slot])
+                    sum += slot_table(segment, slot)[index];
+            const Weight mean = static_cast<Weight>(sum / n_valid);
+            for (int slot = 0; slot < segment.n_workers; slot++)
+                slot_table(segment, slot)[index] = mean;
+        }
+    }
+    return;
+}
+
+/*
+ * Usage: TD_learning_multi.exe [workers] [rounds] [round_episodes] [checkpoint_rounds]
+ * Runs K trainer processes on private tables in one shared segment and
+ * averages them every round_episodes episodes. The supervisor owns logging and
+ * checkpoints (2048_weights.pkl, 2048_scores.txt) and respawns crashed workers.
+ */
+int main(int argc, char** argv)
+{
+    const int n_workers = std::min((argc > 1) ? std::atoi(argv[1]) : 4, MAX_WORKERS);
+    const int rounds = (argc > 2) ? std::atoi(argv[2]) : 10000;
+    const int round_episodes = (argc > 3) ? std::atoi(argv[3]) : 100;
+    const int checkpoint_rounds = (argc > 4) ? std::atoi(argv[4]) : 10;
+    const double epsilon = 0.1;
+    if (n_workers < 1 || round_episodes < 1 || checkpoint_rounds < 1) {
+        std::cerr << "Usage: " << argv[0] << " [workers] [rounds] [round_episodes] [checkpoint_rounds]\n";
+        return 1;
+    }
+    std::vector<Pattern> patterns = default_patterns();
+    NTupleTD agent(patterns, 4, 4, 0, 0.01, 1.0);
+    agent.load_weights("2048_weights.pkl");
+
+    SharedSegment segment;
+    segment.n_weights = agent.weight_count();
+    segment.n_workers = n_workers;
+    segment.round_episodes = round_episodes;
+    const size_t control_bytes = (sizeof(SharedControl) + 4095) / 4096 * 4096;
+    const size_t table_bytes = n_workers * segment.n_weights * sizeof(Weight);
+    const size_t bytes = control_bytes + table_bytes + n_workers * round_episodes * sizeof(int);
+    void* region = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        std::cerr << "Error mapping " << (bytes >> 20) << " MB of shared memory\n";
+        return 1;
+    }
+    segment.control = new (region) SharedControl();
+    segment.tables = reinterpret_cast<Weight*>(static_cast<char*>(region) + control_bytes);
+    segment.scores = reinterpret_cast<int*>(static_cast<char*>(region) + control_bytes + table_bytes);
+    for (int slot = 0; slot < n_workers; slot++)
+        std::memcpy(slot_table(segment, slot), agent.weight_data(), segment.n_weights * sizeof(Weight));
+    // The supervisor reads the averaged table through slot 0 for checkpoints
+    agent.bind_weights(slot_table(segment, 0));
+
+    std::vector<pid_t> workers(n_workers);
+    for (int slot = 0; slot < n_workers; slot++)
+        workers[slot] = spawn_worker(agent, segment, slot, epsilon, false);
+
+    std::vector<int> scores;
+    for (int round = 1; round <= rounds; round++) {
+        const uint64_t generation = segment.control->generation.load();
+        std::vector<bool> valid(n_workers, true);
+        while (true) {
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                const int slot = std::find(workers.begin(), workers.end(), pid) - workers.begin();
+                if (slot == n_workers) continue;
+                std::cerr << "Worker " << slot << " exited (status " << status << "), respawning\n";
+                valid[slot] = false;
+                workers[slot] = spawn_worker(agent, segment, slot, epsilon, true);
+            }
+            int pending = 0;
+            for (int slot = 0; slot < n_workers; slot++)
+                pending += segment.control->arrived[slot].load() != generation + 1;
+            if (pending == 0) break;
+            usleep(1000);
+        }
+        // A worker that crashed this round left a partial table and no scores
+        for (int slot = 0; slot < n_workers; slot++)
+            valid[slot] = valid[slot] && segment.control->n_scores[slot].load() > 0;
+
+        average_tables(segment, valid);
+        const size_t round_start = scores.size();
+        for (int slot = 0; slot < n_workers; slot++)
+            if (valid[slot])
+                scores.insert(scores.end(), segment.scores + slot * round_episodes,
+                              segment.scores + slot * round_episodes + segment.control->n_scores[slot].load());
+        if (scores.size() > round_start) {
+            std::cout << "Round: " << round << ", Episodes: " << scores.size() - round_start << ", Average Score: "
+                      << std::accumulate(scores.begin() + round_start, scores.end(), 0.0) / (scores.size() - round_start) << "\n";
+        }
+        if (round % checkpoint_rounds == 0 || round == rounds) {
+            std::cout << "Saving weights and scores at round " << round << "\n";
+            agent.save_weights("2048_weights.pkl");
+            agent.save_scores("2048_scores.txt", scores);
+            scores.clear();
+        }
+        if (round == rounds)
+            segment.control->stop.store(1);
+        segment.control->generation.fetch_add(1);
+    }
+
+    for (pid_t pid : workers)
+        waitpid(pid, nullptr, 0);
+    munmap(region, bytes);
+    return 0;
+}
@@ -7,20 +7,114 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
 
 int average_interval = 100;
 int save_interval = 1000;
 
+#define WEIGHT_IMAGE_MAGIC "NTUPLEW1"
+#define WEIGHT_IMAGE_ALIGN 4096
+
+/*
+ * Binary weight image: header, pattern list (cell count then y, x pairs as
+ * int32), zero padding up to data_offset, then the raw tables. The tables
+ * start page aligned so players can mmap them in place. The overflow entries
+ * follow the tables: their count (uint64), keys (uint64) and weights. Images
+ * written before the overflow table simply end after the tables.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t n_patterns;
+    uint32_t tile_bits;
+    uint32_t weight_bytes;
+    uint32_t tile_radix;    // Exponents per cell, 0 means 1 << tile_bits
+    double init_value;
+    uint64_t n_weights;
+    uint64_t data_offset;
+} WeightImageHeader;
+
 NTupleTD::NTupleTD(std::vector<Pattern>& patterns, int n_actions, int board_size, double init_value, double learning_rate, double discount_factor)
-    : patterns(patterns), n_actions(n_actions), board_size(board_size), init_value(init_value), learning_rate(learning_rate), discount_factor(discount_factor)
+    : patterns(patterns), n_actions(n_actions), board_size(board_size), init_value(init_value), learning_rate(learning_rate), discount_factor(discount_factor),
+      lambda(0.0), trace_window(1), restart_probability(0.0), pool_capacity(0), pool_next(0),
+      checkpointing(true)
 {
+    if (board_size * board_size > MAX_BOARD_CELLS)
+        throw std::invalid_argument("Board size too large");
+    if (patterns.size() * 8 > MAX_TUPLES)
+        throw std::invalid_argument("Too many patterns");
+    for (const Pattern& pattern : patterns)
+        if (pattern.size() > MAX_OVERFLOW_CELLS)
+            throw std::invalid_argument("Pattern too large");
+
     symmetric_patterns.reserve(patterns.size() * 8);
     for (const Pattern& pattern : this->patterns) {
         std::vector<Pattern> sym_patterns = generate_symmetric_patterns(pattern);
         std::copy(sym_patterns.begin(), sym_patterns.end(), std::back_inserter(symmetric_patterns));
     }
     n_tuples = symmetric_patterns.size();
-    weights.resize(patterns.size());
+
+    for (int index = 0; index < n_tuples; index++) {
+        std::vector<int> cells;
+        for (const Coordinate& coord : symmetric_patterns[index])
+            cells.push_back(coord.first * board_size + coord.second);
+        tuple_cells.push_back(cells);
+    }
+    // Zero tables are only reserved, players that attach a shared weight image never commit a private copy
+    const size_t table_size = set_tile_radix(1 << TILE_BITS);
+    if (init_value == 0)
+        weights.reserve(table_size);
+    else
+        weights.allocate(table_size, static_cast<Weight>(init_value));
+    overflow.reset(static_cast<Weight>(init_value));
+}
+
+// Lays the tables out for exponents 0..tile_radix-1 and returns their total size
+size_t NTupleTD::set_tile_radix(const int tile_radix)
+{
+    this->tile_radix = tile_radix;
+    size_t table_size = 0;
+    table_offsets.clear();
+    for (const Pattern& pattern : patterns) {
+        table_offsets.push_back(table_size);
+        table_size += pattern_table_size(pattern);
+    }
+    tuple_offsets.clear();
+    for (int index = 0; index < n_tuples; index++)
+        tuple_offsets.push_back(table_offsets[index / 8]);
+    static_patterns = (board_size == DEFAULT_BOARD_SIZE && tile_radix == (1 << TILE_BITS) && patterns == default_patterns());
+    return table_size;
+}
+
+size_t NTupleTD::pattern_table_size(const Pattern& pattern) const
+{
+    size_t size = 1;
+    for (int i = 0; i < pattern.size(); i++)
+        size *= tile_radix;
+    return size;
+}
+
+// Mixed-radix feature index: sum of exponent[k] * tile_radix^k
+size_t NTupleTD::encode_feature(const Feature& feature) const
+{
+    size_t index = 0;
+    for (int k = feature.size() - 1; k >= 0; k--)
+        index = index * tile_radix + feature[k];
+    return index;
+}
+
+Feature NTupleTD::decode_feature(size_t index, const int size) const
+{
+    Feature feature(size);
+    for (int k = 0; k < size; k++) {
+        feature[k] = index % tile_radix;
+        index /= tile_radix;
+    }
+    return feature;
 }
 
 std::vector<Pattern> NTupleTD::generate_symmetric_patterns(const Pattern& pattern) const
@@ -42,41 +136,239 @@ int NTupleTD::tile_to_index(const int tile) const
     return static_cast<int>(std::log2(tile));
 }
 
-Feature NTupleTD::get_feature(const Board& board, const Pattern pattern) const
+// Returns the largest exponent on the board
+int NTupleTD::get_exponents(const Board& board, int* exponents) const
 {
-    Feature feature;
-    for (const Coordinate& coord : pattern) {
-        int y = coord.first, x = coord.second;
-        feature.push_back(tile_to_index(board[y][x]));
+    int max_exponent = 0;
+    for (int y = 0; y < board_size; y++) {
+        for (int x = 0; x < board_size; x++) {
+            exponents[y * board_size + x] = tile_to_index(board[y][x]);
+            max_exponent = std::max(max_exponent, exponents[y * board_size + x]);
+        }
+    }
+    return max_exponent;
+}
+
+// Feature indices for learning: overflow features seen for the first time get their own slot
+void NTupleTD::training_feature_indices(const int* exponents, const int max_exponent, size_t* indices)
+{
+    if (!exponent_feature_indices(exponents, max_exponent, indices))
+        return;
+    for (int index = 0; index < n_tuples; index++)
+        if (indices[index] == weights.size())
+            indices[index] = weights.size() + overflow.insert(tuple_overflow_key(index, exponents));
+    return;
+}
+
+/*
+ * Index of each tuple's weight: the dense table entry, or weights.size() plus
+ * the overflow slot when a cell holds an exponent beyond tile_radix (slot 0 if
+ * the feature was never learned). Returns whether any tuple overflowed, which
+ * only boards with a tile above the dense range can do.
+ */
+bool NTupleTD::exponent_feature_indices(const int* exponents, const int max_exponent, size_t* indices) const
+{
+    if (max_exponent < tile_radix) {
+        if (static_patterns) {
+            default_feature_indices(exponents, indices);
+            return false;
+        }
+        for (int index = 0; index < n_tuples; index++) {
+            const std::vector<int>& cells = tuple_cells[index];
+            size_t feature = 0;
+            for (int i = cells.size() - 1; i >= 0; i--)
+                feature = feature * tile_radix + exponents[cells[i]];
+            indices[index] = tuple_offsets[index] + feature;
+        }
+        return false;
     }
+
+    bool has_overflow = false;
+    for (int index = 0; index < n_tuples; index++) {
+        const std::vector<int>& cells = tuple_cells[index];
+        size_t feature = 0;
+        bool dense = true;
+        for (int i = cells.size() - 1; i >= 0; i--) {
+            dense = dense && exponents[cells[i]] < tile_radix;
+            feature = feature * tile_radix + exponents[cells[i]];
+        }
+        if (dense)
+            indices[index] = tuple_offsets[index] + feature;
+        else {
+            indices[index] = weights.size() + overflow.find(tuple_overflow_key(index, exponents));
+            has_overflow = true;
+        }
+    }
+    return has_overflow;
+}
+
+// Pattern index and the exponent of each cell, OVERFLOW_CELL_BITS apiece; the top bit keeps keys non-zero
+uint64_t NTupleTD::overflow_key(const int pattern_index, const int* feature, const int size) const
+{
+    const uint64_t cell_mask = (1 << OVERFLOW_CELL_BITS) - 1;
+    uint64_t key = (uint64_t(1) << 63) | (uint64_t(pattern_index) << (OVERFLOW_CELL_BITS * MAX_OVERFLOW_CELLS));
+    for (int k = 0; k < size; k++)
+        key |= std::min<uint64_t>(feature[k], cell_mask) << (OVERFLOW_CELL_BITS * k);
+    return key;
+}
+
+// Symmetric tuples of one pattern share its overflow entries, as they share its dense table
+uint64_t NTupleTD::tuple_overflow_key(const int tuple_index, const int* exponents) const
+{
+    const std::vector<int>& cells = tuple_cells[tuple_index];
+    int feature[MAX_OVERFLOW_CELLS];
+    for (int k = 0; k < cells.size(); k++)
+        feature[k] = exponents[cells[k]];
+    return overflow_key(tuple_index / 8, feature, cells.size());
+}
+
+int NTupleTD::overflow_pattern(const uint64_t key) const
+{
+    return (key >> (OVERFLOW_CELL_BITS * MAX_OVERFLOW_CELLS)) & 0xff;
+}
+
+Feature NTupleTD::overflow_feature(const uint64_t key) const
+{
+    Feature feature(patterns[overflow_pattern(key)].size());
+    for (int k = 0; k < feature.size(); k++)
+        feature[k] = (key >> (OVERFLOW_CELL_BITS * k)) & ((1 << OVERFLOW_CELL_BITS) - 1);
     return feature;
 }
 
-double NTupleTD::cal_value(const Board& board) const
+double NTupleTD::sum_weights(const Weight* table, const size_t* indices, const bool has_overflow) const
 {
     double value = 0;
-    for(int index = 0; index < n_tuples; index++){
-        const Pattern& pattern = symmetric_patterns[index];
-        Feature feature = get_feature(board, pattern);
-        auto it = weights.at(index / 8).find(feature);
-        if (it != weights.at(index / 8).end())
-            value += it->second;
-        else 
-            value += init_value;
+    if (!has_overflow) {
+        for (int index = 0; index < n_tuples; index++)
+            value += table[indices[index]];
+        return value;
     }
+    const size_t dense_size = weights.size();
+    for (int index = 0; index < n_tuples; index++)
+        value += (indices[index] < dense_size) ? table[indices[index]] : overflow[indices[index] - dense_size];
     return value;
 }
 
-void NTupleTD::update_weights(const Board& board, const double delta)
+Weight& NTupleTD::weight_ref(const size_t index)
 {
-    for(int index = 0; index < n_tuples; index++){
-        const Pattern& pattern = symmetric_patterns[index];
-        Feature feature = get_feature(board, pattern);
-        auto it = weights[index / 8].find(feature);
-        if (it != weights[index / 8].end())
-            it->second += learning_rate * delta;
-        else
-            weights[index / 8][feature] = init_value + learning_rate * delta;
+    return (index < weights.size()) ? weights[index] : overflow[index - weights.size()];
+}
+
+// Turns reserved zero tables into a writable allocation before their first write
+void NTupleTD::allocate_reserved_weights()
+{
+    if (weights.is_reserved())
+        weights.allocate(weights.size(), static_cast<Weight>(init_value));
+    return;
+}
+
+// Number of ordered pairs (j, k) with indices[j] == indices[k]: an entry shared
+// by several symmetric tuples of one board is updated once per tuple
+int NTupleTD::index_multiplicity(const size_t* indices) const
+{
+    int multiplicity = n_tuples;
+    for (int base = 0; base < n_tuples; base += 8)
+        for (int j = base; j < base + 8; j++)
+            for (int k = j + 1; k < base + 8; k++)
+                if (indices[j] == indices[k])
+                    multiplicity += 2;
+    return multiplicity;
+}
+
+double NTupleTD::cal_value(const Board& board) const
+{
+    int exponents[MAX_BOARD_CELLS];
+    const int max_exponent = get_exponents(board, exponents);
+    const Weight* table = weights.read_table();
+    if (static_patterns && max_exponent < tile_radix)
+        return default_value(table, exponents);
+    size_t indices[MAX_TUPLES];
+    const bool has_overflow = exponent_feature_indices(exponents, max_exponent, indices);
+    return sum_weights(table, indices, has_overflow);
+}
+
+PackedStep NTupleTD::pack_board(const Board& board) const
+{
+    PackedStep step = {0, 0, false, false, 0};
+    for (int y = 0; y < board_size; y++) {
+        for (int x = 0; x < board_size; x++) {
+            const int cell = y * board_size + x;
+            const int exponent = std::min(tile_to_index(board[y][x]), 31);
+            step.cells |= static_cast<uint64_t>(exponent & 0xF) << (4 * cell);
+            step.high_cells |= (exponent >> 4) << cell;
+        }
+    }
+    return step;
+}
+
+// Returns the largest exponent, as get_exponents does
+int NTupleTD::unpack_exponents(const PackedStep& step, int* exponents) const
+{
+    int max_exponent = 0;
+    for (int cell = 0; cell < board_size * board_size; cell++) {
+        exponents[cell] = ((step.cells >> (4 * cell)) & 0xF) | (((step.high_cells >> cell) & 1) << 4);
+        max_exponent = std::max(max_exponent, exponents[cell]);
+    }
+    return max_exponent;
+}
+
+double NTupleTD::cal_value(const PackedStep& step) const
+{
+    int exponents[PACKED_STEP_CELLS];
+    const int max_exponent = unpack_exponents(step, exponents);
+    const Weight* table = weights.read_table();
+    if (static_patterns && max_exponent < tile_radix)
+        return default_value(table, exponents);
+    size_t indices[MAX_TUPLES];
+    const bool has_overflow = exponent_feature_indices(exponents, max_exponent, indices);
+    return sum_weights(table, indices, has_overflow);
+}
+
+/*
+ * Largest exponent of a BitBoard as far as the tables are concerned: with the
+ * full radix every BitBoard exponent (at most BITBOARD_MAX_EXPONENT) has a
+ * dense entry, so only compacted tables need the cells scanned.
+ */
+int NTupleTD::bitboard_max_exponent(const int* exponents) const
+{
+    if (tile_radix > BITBOARD_MAX_EXPONENT)
+        return 0;
+    int max_exponent = 0;
+    for (int cell = 0; cell < BITBOARD_CELLS; cell++)
+        max_exponent = std::max(max_exponent, exponents[cell]);
+    return max_exponent;
+}
+
+// Feature indices of a board with its dense weights prefetched; true if any index is in the overflow table
+bool NTupleTD::prefetch_weights(const Weight* table, const BitBoard board, size_t* indices) const
+{
+    int exponents[BITBOARD_CELLS];
+    bitboard_exponents(board, exponents);
+    const bool has_overflow = exponent_feature_indices(exponents, bitboard_max_exponent(exponents), indices);
+    for (int index = 0; !has_overflow && index < n_tuples; index++)
+        __builtin_prefetch(&table[indices[index]]);
+    return has_overflow;
+}
+
+/*
+ * Evaluates a batch of boards as a pipeline: the weights of the next
+ * VALUE_PREFETCH_WINDOW boards are prefetched while a board is summed, so
+ * their cache misses overlap with each other and with the summing instead of
+ * being paid one board at a time. Any n_boards, no heap allocation.
+ */
+void NTupleTD::cal_values(const BitBoard* boards, const int n_boards, double* values) const
+{
+    const int window = VALUE_PREFETCH_WINDOW;
+    const Weight* table = weights.read_table();
+    size_t indices[window][MAX_TUPLES];
+    bool has_overflow[window];
+    for (int b = 0; b < std::min(window, n_boards); b++)
+        has_overflow[b] = prefetch_weights(table, boards[b], indices[b]);
+    for (int b = 0; b < n_boards; b++) {
+        const int slot = b % window;
+        values[b] = sum_weights(table, indices[slot], has_overflow[slot]);
+        if (b + window < n_boards)
+            has_overflow[slot] = prefetch_weights(table, boards[b + window], indices[slot]);
     }
     return;
 }
@@ -90,13 +382,111 @@ double NTupleTD::simulate_action(Env2048 env, const Board& board, const int acti
     return static_cast<double>(result.score) + discount_factor * value;
 }
 
-void NTupleTD::learn(const Experience& experience)
+/*
+ * One backup towards target on precomputed feature indices: every entry is
+ * read once and written once. The updated value of the state is returned so
+ * the backward sweep can use it as the next value of the preceding step
+ * without re-evaluating a board; error, if given, gets target minus the value
+ * before the update.
+ */
+double NTupleTD::learn(const size_t* indices, const double target, double* error)
+{
+    double current_value = 0;
+    for(int index = 0; index < n_tuples; index++)
+        current_value += weight_ref(indices[index]);
+    if (error != nullptr)
+        *error = target - current_value;
+    double step = learning_rate * (target - current_value);
+    for(int index = 0; index < n_tuples; index++)
+        weight_ref(indices[index]) += step;
+    return current_value + step * index_multiplicity(indices);
+}
+
+/*
+ * Truncated lambda-return of a step, built from the rewards and the afterstate
+ * values the backward sweep already produced for the following steps:
+ * G_k = r_k + gamma * ((1 - lambda) * V(s_k+1) + lambda * G_k+1), with the last
+ * step of the window bootstrapping on V(s_k+1) alone.
+ */
+double NTupleTD::lambda_target(const int step) const
 {
-    double current_value = cal_value(experience.beforestate);
-    double next_value = cal_value(experience.afterstate);
-    double target = static_cast<double>(experience.reward) + (experience.done ? 0 : discount_factor * next_value);
-    double delta = target - current_value;
-    update_weights(experience.beforestate, delta);
+    const int last = std::min(step + trace_window, static_cast<int>(trajectory.size())) - 1;
+    double target = trajectory[last].reward + (trajectory[last].done ? 0 : discount_factor * next_values[last]);
+    for(int k = last - 1; k >= step; k--) {
+        double bootstrap = (1 - lambda) * next_values[k] + lambda * target;
+        target = trajectory[k].reward + (trajectory[k].done ? 0 : discount_factor * bootstrap);
+    }
+    return target;
+}
+
+void NTupleTD::set_lambda(const double lambda, const int trace_window)
+{
+    this->lambda = lambda;
+    this->trace_window = std::max(trace_window, 1);
+    return;
+}
+
+// With checkpointing off, train() neither logs nor saves and returns every score
+void NTupleTD::set_checkpointing(const bool enabled)
+{
+    checkpointing = enabled;
+    return;
+}
+
+// Hook run on the training thread after every saved checkpoint, e.g. to evaluate it
+void NTupleTD::set_checkpoint_callback(const std::function<void(const NTupleTD&, int)>& callback)
+{
+    checkpoint_callback = callback;
+    return;
+}
+
+/*
+ * Curriculum over late-game positions: while training, the board is recorded
+ * each time one of capture_tiles first appears in an episode (up to
+ * pool_capacity boards, the oldest replaced first), and an episode then starts
+ * from a random recorded board with restart_probability instead of a fresh
+ * game. Only fresh games enter the score statistics.
+ */
+void NTupleTD::set_curriculum(const double restart_probability, const std::vector<int>& capture_tiles, const int pool_capacity)
+{
+    this->restart_probability = restart_probability;
+    this->capture_tiles = capture_tiles;
+    std::sort(this->capture_tiles.begin(), this->capture_tiles.end());
+    this->pool_capacity = std::max(pool_capacity, 0);
+    start_pool.clear();
+    pool_next = 0;
+    return;
+}
+
+// Resets env or restores a recorded board, returns the number of capture tiles already reached
+int NTupleTD::start_episode(Env2048& env, bool& restarted)
+{
+    restarted = false;
+    if (restart_probability > 0 && !start_pool.empty()
+     && static_cast<double>(rand()) / RAND_MAX < restart_probability) {
+        env.set_board(start_pool[rand() % start_pool.size()]);
+        env.set_score(0);
+        restarted = true;
+    }
+    else
+        env.reset();
+
+    int max_tile = 0;
+    for (const Row& row : env.get_board())
+        max_tile = std::max(max_tile, *std::max_element(row.begin(), row.end()));
+    return std::upper_bound(capture_tiles.begin(), capture_tiles.end(), max_tile) - capture_tiles.begin();
+}
+
+void NTupleTD::capture_start(const Board& board)
+{
+    if (pool_capacity == 0)
+        return;
+    if (start_pool.size() < pool_capacity) {
+        start_pool.push_back(board);
+        return;
+    }
+    start_pool[pool_next] = board;
+    pool_next = (pool_next + 1) % pool_capacity;
     return;
 }
 
@@ -104,43 +494,79 @@ std::vector<int> NTupleTD::train(Env2048& env, const int episodes, const double
 {
     std::vector<int> scores;
     scores.reserve(episodes);
+    allocate_reserved_weights();
+    if (weights.is_read_only()) {
+        std::cerr << "Cannot train on a read-only or replicated weight image, load the weights instead\n";
+        return scores;
+    }
+    if (board_size * board_size > PACKED_STEP_CELLS) {
+        std::cerr << "Training supports boards up to 4x4\n";
+        return scores;
+    }
 
     try{
         for (int episode = 0; episode < episodes; episode++) {
-            Board beforestate(board_size, Row(board_size, 0)), afterstate;
-            std::vector<Experience> trajectory;
+            PackedStep beforestate = {0, 0, false, false, 0};
             int prev_score = 0;
             bool done = false;
+            bool restarted;
 
-            env.reset();
+            int captured = start_episode(env, restarted);
+            if (restarted)
+                beforestate = pack_board(env.get_board());
+            trajectory.clear();
             while (!done){
                 int action = choose_action(env, epsilon);
                 if(action == -1)    break;
 
                 StepResult result = env.step(action);
-                afterstate = result.board;
-                int reward = result.score - prev_score;
                 done = result.game_over;
-
-                trajectory.push_back({beforestate, action, reward, afterstate, done});
+                beforestate.reward = result.score - prev_score;
+                beforestate.done = done;
+                trajectory.push_back(beforestate);
                 prev_score = result.score;
-                beforestate = afterstate;
+                beforestate = pack_board(result.board);
+                if (captured < capture_tiles.size() && restart_probability > 0) {
+                    int max_tile = 0;
+                    for (const Row& row : result.board)
+                        max_tile = std::max(max_tile, *std::max_element(row.begin(), row.end()));
+                    if (max_tile >= capture_tiles[captured])
+                        capture_start(result.board);
+                    while (captured < capture_tiles.size() && max_tile >= capture_tiles[captured])
+                        captured++;
+                }
             }
 
+            // Backward sweep: one-step TD, or TD(lambda) over a truncated window of later steps
+            double next_value = 0;
+            next_values.resize(trajectory.size());
             for(int i = trajectory.size() - 1; i >= 0; i--) {
-                Experience& exp = trajectory[i];
-                learn(exp);
+                const PackedStep& step = trajectory[i];
+                int exponents[PACKED_STEP_CELLS];
+                size_t indices[MAX_TUPLES];
+                training_feature_indices(exponents, unpack_exponents(step, exponents), indices);
+                double target;
+                if (lambda > 0 && trace_window > 1) {
+                    next_values[i] = next_value;
+                    target = lambda_target(i);
+                }
+                else
+                    target = static_cast<double>(step.reward) + (step.done ? 0 : discount_factor * next_value);
+                next_value = learn(indices, target);
             }
-            scores.push_back(env.get_score());
-            if (episode % average_interval == 0) {
+            if (!restarted)
+                scores.push_back(env.get_score());
+            if (checkpointing && episode % average_interval == 0 && !scores.empty()) {
                 double avg_score = std::accumulate(scores.end() - std::min(average_interval, static_cast<int>(scores.size())), scores.end(), 0.0) / std::min(average_interval, static_cast<int>(scores.size()));
                 std::cout << "Episode: " << episode << ", Average Score: " << avg_score << "\n";
             }
-            if (episode % save_interval == 0 && episode > 0) {
+            if (checkpointing && episode % save_interval == 0 && episode > 0) {
                 std::cout << "Saving weights and scores at episode " << episode << "\n";
                 save_weights("2048_weights.pkl");
                 save_scores("2048_scores.txt", scores);
                 scores.clear();
+                if (checkpoint_callback)
+                    checkpoint_callback(*this, episode);
             }
         }
     }
@@ -153,8 +579,59 @@ std::vector<int> NTupleTD::train(Env2048& env, const int episodes, const double
     return scores;
 }
 
+/*
+ * One supervised step of the afterstate value towards target (e.g. a searched
+ * value). Returns the error before the update, target - V, and writes the
+ * updated value to updated_value if given, all from one pass over the tables.
+ */
+double NTupleTD::regress(const Board& afterstate, const double target, double* updated_value)
+{
+    allocate_reserved_weights();
+    if (weights.is_read_only()) {
+        std::cerr << "Cannot train on a read-only or replicated weight image, load the weights instead\n";
+        const double value = cal_value(afterstate);
+        if (updated_value != nullptr)
+            *updated_value = value;
+        return target - value;
+    }
+    int exponents[MAX_BOARD_CELLS];
+    size_t indices[MAX_TUPLES];
+    const int max_exponent = get_exponents(afterstate, exponents);
+    training_feature_indices(exponents, max_exponent, indices);
+    double error;
+    const double value = learn(indices, target, &error);
+    if (updated_value != nullptr)
+        *updated_value = value;
+    return error;
+}
+
+// Same on the state of a recorded step, e.g. for offline training
+double NTupleTD::regress(const PackedStep& step, const double target, double* updated_value)
+{
+    allocate_reserved_weights();
+    if (weights.is_read_only()) {
+        std::cerr << "Cannot train on a read-only or replicated weight image, load the weights instead\n";
+        const double value = cal_value(step);
+        if (updated_value != nullptr)
+            *updated_value = value;
+        return target - value;
+    }
+    int exponents[PACKED_STEP_CELLS];
+    size_t indices[MAX_TUPLES];
+    training_feature_indices(exponents, unpack_exponents(step, exponents), indices);
+    double error;
+    const double value = learn(indices, target, &error);
+    if (updated_value != nullptr)
+        *updated_value = value;
+    return error;
+}
+
 int NTupleTD::choose_action(Env2048& env, const double epsilon)
 {
+    BitBoard board;
+    if (board_size == BITBOARD_SIZE && to_bitboard(env.get_board(), board))
+        return choose_action(board, epsilon);
+
     std::vector<int> legal_actions = env.get_legal_actions();
     if (legal_actions.empty()) return -1;
     if (static_cast<double>(rand()) / RAND_MAX < epsilon)
@@ -167,6 +644,52 @@ int NTupleTD::choose_action(Env2048& env, const double epsilon)
     return std::distance(action_values.begin(), std::max_element(action_values.begin(), action_values.end()));
 }
 
+/*
+ * Greedy / epsilon-greedy selection on a packed board, all afterstates
+ * evaluated as one batch. With epsilon 0 rand() is never drawn, so callers
+ * off the training thread can use it, and best_value (if given) receives the
+ * greedy value r + gamma V, or 0 when no move is left.
+ */
+int NTupleTD::choose_action(const BitBoard board, const double epsilon, double* best_value) const
+{
+    BitBoard afterstates[4];
+    int rewards[4];
+    const int legal = bitboard_afterstates(board, afterstates, rewards);
+    if (best_value != nullptr)
+        *best_value = 0;
+    if (legal == 0) return -1;
+    if (epsilon > 0 && static_cast<double>(rand()) / RAND_MAX < epsilon) {
+        int nth = rand() % __builtin_popcount(legal);
+        for (int action = 0; action < 4; action++)
+            if ((legal >> action) & 1 && nth-- == 0)
+                return action;
+    }
+
+    BitBoard candidates[4];
+    int actions[4], n_legal = 0;
+    for (int action = 0; action < 4; action++) {
+        if ((legal >> action) & 1) {
+            candidates[n_legal] = afterstates[action];
+            actions[n_legal++] = action;
+        }
+    }
+    double values[4];
+    cal_values(candidates, n_legal, values);
+
+    int best_action = actions[0];
+    double max_value = -std::numeric_limits<double>::infinity();
+    for (int i = 0; i < n_legal; i++) {
+        const double value = static_cast<double>(rewards[actions[i]]) + discount_factor * values[i];
+        if (value > max_value) {
+            max_value = value;
+            best_action = actions[i];
+        }
+    }
+    if (best_value != nullptr)
+        *best_value = max_value;
+    return best_action;
+}
+
 void NTupleTD::save_scores(const std::string& path, const std::vector<int>& scores) const
 {
     std::ofstream ofs(path, std::ios_base::app);
@@ -189,14 +712,24 @@ void NTupleTD::save_weights(const std::string& path) const
         return;
     }
 
-    for(int i = 0; i < weights.size(); i++) {
-        const WeightsMap& weight_map = weights[i];
+    const Weight init_weight = static_cast<Weight>(init_value);
+    for(int i = 0; i < patterns.size(); i++) {
+        const size_t table_size = pattern_table_size(patterns[i]);
         ofs << "Pattern " << i << ":\n";
-        for(const auto& pair : weight_map) {
-            for(int feature : pair.first) {
-                ofs << feature << " ";
+        for(size_t index = 0; index < table_size; index++) {
+            const Weight weight = weights[table_offsets[i] + index];
+            if(weight == init_weight) continue;
+            for(int tile : decode_feature(index, patterns[i].size())) {
+                ofs << tile << " ";
+            }
+            ofs << "; " << weight << "\n";
+        }
+        for(size_t slot = 1; slot <= overflow.size(); slot++) {
+            if(overflow_pattern(overflow.key(slot)) != i) continue;
+            for(int tile : overflow_feature(overflow.key(slot))) {
+                ofs << tile << " ";
             }
-            ofs << "; " << pair.second << "\n";
+            ofs << "; " << overflow[slot] << "\n";
         }
     }
     ofs.close();
@@ -211,10 +744,14 @@ void NTupleTD::load_weights(const std::string& path)
         std::cerr << "Error opening file for loading weights: " << path << "\n";
         return;
     }
-    weights.clear();
-    weights.resize(patterns.size());
+    if(weights.is_read_only() || weights.is_reserved())
+        weights.allocate(weights.size(), static_cast<Weight>(init_value));
+    else
+        weights.fill(static_cast<Weight>(init_value));
+    overflow.reset(static_cast<Weight>(init_value));
     std::string line;
     int pattern_index = -1;
+    int skipped = 0;
     while(std::getline(ifs, line)) {
         if(line.empty() || line[0] == '#') continue;
         if(line.find("Pattern") != std::string::npos) {
@@ -223,7 +760,6 @@ void NTupleTD::load_weights(const std::string& path)
                 std::cerr << "Invalid pattern index in weights file: " << pattern_index << "\n";
                 continue;
             }
-            weights[pattern_index].clear();
         } 
         else {
             std::istringstream iss(line);
@@ -239,14 +775,394 @@ void NTupleTD::load_weights(const std::string& path)
                 }
             }
             iss >> weight;
-            weights[pattern_index][feature] = weight;
+            if(pattern_index < 0 || pattern_index >= patterns.size() || feature.size() != patterns[pattern_index].size()) {
+                skipped++;
+                continue;
+            }
+            bool in_range = true, dense = true;
+            for(int tile : feature) {
+                in_range = in_range && tile >= 0 && tile < (1 << OVERFLOW_CELL_BITS);
+                dense = dense && tile < tile_radix;
+            }
+            if(!in_range) {
+                skipped++;
+                continue;
+            }
+            if(dense)
+                weights[table_offsets[pattern_index] + encode_feature(feature)] = static_cast<Weight>(weight);
+            else
+                overflow[overflow.insert(overflow_key(pattern_index, feature.data(), feature.size()))] = static_cast<Weight>(weight);
         }
     }
     ifs.close();
+    if(skipped > 0)
+        std::cerr << "Skipped " << skipped << " weights outside the tile range of the tables\n";
     std::cout << "Weights loaded from " << path << "\n";
     return;
 }
 
+std::vector<Pattern> default_patterns()
+{
+    std::vector<Pattern> patterns(DEFAULT_N_PATTERNS);
+    for (int p = 0; p < DEFAULT_N_PATTERNS; p++)
+        for (int k = 0; k < DEFAULT_TUPLE_SIZE; k++)
+            patterns[p].emplace_back(std::make_pair(DEFAULT_PATTERNS[p][k][0], DEFAULT_PATTERNS[p][k][1]));
+    return patterns;
+}
+
+void NTupleTD::save_weights_image(const std::string& path) const
+{
+    std::ofstream ofs(path, std::ios_base::binary);
+    if(!ofs.is_open()) {
+        std::cerr << "Error opening file for saving weight image: " << path << "\n";
+        return;
+    }
+    WeightImageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, WEIGHT_IMAGE_MAGIC, sizeof(header.magic));
+    header.n_patterns = patterns.size();
+    header.tile_bits = TILE_BITS;
+    header.weight_bytes = sizeof(Weight);
+    header.tile_radix = tile_radix;
+    header.init_value = init_value;
+    header.n_weights = weights.size();
+
+    std::vector<int32_t> pattern_list;
+    for(const Pattern& pattern : patterns) {
+        pattern_list.push_back(pattern.size());
+        for(const Coordinate& coord : pattern) {
+            pattern_list.push_back(coord.first);
+            pattern_list.push_back(coord.second);
+        }
+    }
+    const size_t used = sizeof(header) + pattern_list.size() * sizeof(int32_t);
+    header.data_offset = (used + WEIGHT_IMAGE_ALIGN - 1) / WEIGHT_IMAGE_ALIGN * WEIGHT_IMAGE_ALIGN;
+
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(pattern_list.data()), pattern_list.size() * sizeof(int32_t));
+    std::vector<char> padding(header.data_offset - used, 0);
+    ofs.write(padding.data(), padding.size());
+    ofs.write(reinterpret_cast<const char*>(weights.data()), weights.size() * sizeof(Weight));
+    const uint64_t n_overflow = overflow.size();
+    ofs.write(reinterpret_cast<const char*>(&n_overflow), sizeof(n_overflow));
+    for(size_t slot = 1; slot <= n_overflow; slot++) {
+        const uint64_t key = overflow.key(slot);
+        ofs.write(reinterpret_cast<const char*>(&key), sizeof(key));
+    }
+    for(size_t slot = 1; slot <= n_overflow; slot++)
+        ofs.write(reinterpret_cast<const char*>(&overflow[slot]), sizeof(Weight));
+    ofs.close();
+    std::cout << "Weight image saved to " << path << "\n";
+    return;
+}
+
+bool NTupleTD::map_weights_image(const std::string& path)
+{
+    std::ifstream ifs(path, std::ios_base::binary);
+    WeightImageHeader header;
+    if(!ifs.read(reinterpret_cast<char*>(&header), sizeof(header))
+    || std::memcmp(header.magic, WEIGHT_IMAGE_MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << "Not a weight image: " << path << "\n";
+        return false;
+    }
+    const int radix = (header.tile_radix == 0) ? (1 << header.tile_bits) : header.tile_radix;
+    bool match = header.n_patterns == patterns.size() && header.tile_bits == TILE_BITS
+              && header.weight_bytes == sizeof(Weight) && radix >= 2 && radix <= (1 << TILE_BITS);
+    for(int i = 0; match && i < patterns.size(); i++) {
+        int32_t size = 0;
+        ifs.read(reinterpret_cast<char*>(&size), sizeof(size));
+        match = ifs && size == patterns[i].size();
+        for(int k = 0; match && k < size; k++) {
+            int32_t coord[2];
+            ifs.read(reinterpret_cast<char*>(coord), sizeof(coord));
+            match = ifs && coord[0] == patterns[i][k].first && coord[1] == patterns[i][k].second;
+        }
+    }
+    if(!match) {
+        std::cerr << "Weight image does not match the agent's patterns: " << path << "\n";
+        return false;
+    }
+    const int previous_radix = tile_radix;
+    if(set_tile_radix(radix) != header.n_weights
+    || !weights.map_file(path, header.data_offset, header.n_weights)) {
+        set_tile_radix(previous_radix);
+        std::cerr << "Error mapping weight image: " << path << "\n";
+        return false;
+    }
+    init_value = header.init_value;
+
+    // The overflow entries are few, they are read into the private overflow table
+    overflow.reset(static_cast<Weight>(init_value));
+    uint64_t n_overflow = 0;
+    ifs.seekg(header.data_offset + header.n_weights * sizeof(Weight));
+    if(!ifs.read(reinterpret_cast<char*>(&n_overflow), sizeof(n_overflow)))
+        return true;
+    std::vector<uint64_t> keys(n_overflow);
+    std::vector<Weight> values(n_overflow);
+    ifs.read(reinterpret_cast<char*>(keys.data()), n_overflow * sizeof(uint64_t));
+    ifs.read(reinterpret_cast<char*>(values.data()), n_overflow * sizeof(Weight));
+    if(!ifs) {
+        std::cerr << "Truncated overflow entries in weight image: " << path << "\n";
+        return true;
+    }
+    for(size_t i = 0; i < n_overflow; i++)
+        overflow[overflow.insert(keys[i])] = values[i];
+    return true;
+}
+
+/*
+ * Shares one read-only copy of the weights between player processes. The
+ * first process (or the first one after the text weights changed) converts
+ * text_path into the binary image and publishes it with an atomic rename;
+ * every process then maps the image, so the tables live once in the page
+ * cache however many players run. Returns false if nothing could be mapped.
+ */
+bool NTupleTD::attach_weights(const std::string& image_path, const std::string& text_path)
+{
+    struct stat image_stat, text_stat;
+    const bool has_image = stat(image_path.c_str(), &image_stat) == 0;
+    const bool has_text = stat(text_path.c_str(), &text_stat) == 0;
+    if(!has_image && !has_text) {
+        std::cerr << "No weights to attach: " << image_path << ", " << text_path << "\n";
+        return false;
+    }
+    if(!has_image || (has_text && text_stat.st_mtime > image_stat.st_mtime)) {
+        load_weights(text_path);
+        const std::string temp_path = image_path + ".tmp" + std::to_string(getpid());
+        save_weights_image(temp_path);
+        if(std::rename(temp_path.c_str(), image_path.c_str()) != 0) {
+            std::cerr << "Error publishing weight image: " << image_path << "\n";
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+    if(!map_weights_image(image_path)) {
+        std::cerr << "Falling back to a private copy of " << text_path << "\n";
+        load_weights(text_path);
+        return false;
+    }
+    std::cout << "Weights attached from " << image_path << "\n";
+    return true;
+}
+
+/*
+ * Prints, per pattern, how many table entries were ever moved off init_value,
+ * how many of those stayed within epsilon of it (rarely visited), a histogram
+ * of the learned values and the largest tile exponent each cell saw, then the
+ * dense memory the tables would need at the smallest radix covering them.
+ */
+void NTupleTD::analyze_weights(const double epsilon) const
+{
+    const Weight init_weight = static_cast<Weight>(init_value);
+    const int n_bins = 10;
+    int max_exponent = 0;
+    size_t total_used = 0, total_rare = 0;
+
+    std::cout << "Tile radix " << tile_radix << ", " << weights.size() << " entries ("
+              << weights.size() * sizeof(Weight) / (1 << 20) << " MB)\n";
+    for(int i = 0; i < patterns.size(); i++) {
+        const size_t table_size = pattern_table_size(patterns[i]);
+        const Weight* table = weights.data() + table_offsets[i];
+        size_t used = 0, rare = 0;
+        Weight min_weight = std::numeric_limits<Weight>::max(), max_weight = std::numeric_limits<Weight>::lowest();
+        std::vector<int> cell_max(patterns[i].size(), 0);
+        std::vector<size_t> by_exponent(tile_radix, 0);
+        for(size_t index = 0; index < table_size; index++) {
+            if(table[index] == init_weight) continue;
+            used++;
+            if(std::fabs(table[index] - init_weight) <= epsilon) rare++;
+            min_weight = std::min(min_weight, table[index]);
+            max_weight = std::max(max_weight, table[index]);
+            size_t rest = index;
+            int largest = 0;
+            for(int k = 0; k < patterns[i].size(); k++) {
+                const int exponent = rest % tile_radix;
+                rest /= tile_radix;
+                cell_max[k] = std::max(cell_max[k], exponent);
+                largest = std::max(largest, exponent);
+            }
+            by_exponent[largest]++;
+        }
+        total_used += used;
+        total_rare += rare;
+
+        std::cout << "Pattern " << i << ": " << used << " / " << table_size << " entries used ("
+                  << 100.0 * used / table_size << "%), " << rare << " within " << epsilon << " of init_value\n";
+        if(used == 0) continue;
+        std::cout << "  Largest exponent per cell:";
+        for(int exponent : cell_max) {
+            std::cout << " " << exponent;
+            max_exponent = std::max(max_exponent, exponent);
+        }
+        std::cout << "\n  Entries by largest exponent:";
+        for(int exponent = 0; exponent < tile_radix; exponent++)
+            if(by_exponent[exponent] > 0)
+                std::cout << " " << exponent << ":" << by_exponent[exponent];
+        std::vector<size_t> histogram(n_bins, 0);
+        const double width = (static_cast<double>(max_weight) - min_weight) / n_bins;
+        for(size_t index = 0; index < table_size; index++) {
+            if(table[index] == init_weight) continue;
+            const int bin = (width > 0) ? static_cast<int>((table[index] - min_weight) / width) : 0;
+            histogram[std::min(bin, n_bins - 1)]++;
+        }
+        std::cout << "\n  Value histogram [" << min_weight << ", " << max_weight << "]:";
+        for(size_t count : histogram)
+            std::cout << " " << count;
+        std::cout << "\n";
+    }
+
+    for(size_t slot = 1; slot <= overflow.size(); slot++)
+        for(int exponent : overflow_feature(overflow.key(slot)))
+            max_exponent = std::max(max_exponent, exponent);
+    std::cout << "Overflow entries (exponent >= " << tile_radix << "): " << overflow.size() << "\n";
+    size_t dense_size = 0;
+    for(const Pattern& pattern : patterns) {
+        size_t size = 1;
+        for(int k = 0; k < pattern.size(); k++)
+            size *= max_exponent + 1;
+        dense_size += size;
+    }
+    std::cout << "Used entries: " << total_used << " (" << total_used - total_rare << " after pruning)\n";
+    std::cout << "Largest exponent " << max_exponent << ": dense tables at radix " << max_exponent + 1
+              << " need " << dense_size * sizeof(Weight) / (1 << 20) << " MB\n";
+    return;
+}
+
+/*
+ * Resets entries within epsilon of init_value and re-lays the tables out for
+ * exponents 0..tile_radix-1. Entries holding a larger exponent move to the
+ * overflow table (and overflow entries that now fit move back), so pick
+ * tile_radix from analyze_weights to keep the overflow small. The result is a
+ * private writable copy.
+ */
+void NTupleTD::compact_weights(const double epsilon, const int tile_radix)
+{
+    if(tile_radix < 2 || tile_radix > (1 << TILE_BITS)) {
+        std::cerr << "Invalid tile radix for compaction: " << tile_radix << "\n";
+        return;
+    }
+    const Weight init_weight = static_cast<Weight>(init_value);
+    const int old_radix = this->tile_radix;
+    const std::vector<size_t> old_offsets = table_offsets;
+    std::vector<size_t> old_sizes;
+    for(const Pattern& pattern : patterns)
+        old_sizes.push_back(pattern_table_size(pattern));
+
+    std::vector<Weight> compacted(set_tile_radix(tile_radix), init_weight);
+    OverflowTable compacted_overflow;
+    compacted_overflow.reset(init_weight);
+    size_t kept = 0, pruned = 0;
+    auto place = [&](const int pattern_index, const Feature& feature, const Weight weight) {
+        if(std::fabs(weight - init_weight) <= epsilon) {
+            pruned++;
+            return;
+        }
+        bool dense = true;
+        for(int exponent : feature)
+            dense = dense && exponent < tile_radix;
+        if(dense)
+            compacted[table_offsets[pattern_index] + encode_feature(feature)] = weight;
+        else
+            compacted_overflow[compacted_overflow.insert(overflow_key(pattern_index, feature.data(), feature.size()))] = weight;
+        kept++;
+    };
+    for(int i = 0; i < patterns.size(); i++) {
+        const Weight* table = weights.data() + old_offsets[i];
+        for(size_t index = 0; index < old_sizes[i]; index++) {
+            if(table[index] == init_weight) continue;
+            Feature feature(patterns[i].size());
+            size_t rest = index;
+            for(int k = 0; k < patterns[i].size(); k++) {
+                feature[k] = rest % old_radix;
+                rest /= old_radix;
+            }
+            place(i, feature, table[index]);
+        }
+    }
+    for(size_t slot = 1; slot <= overflow.size(); slot++)
+        place(overflow_pattern(overflow.key(slot)), overflow_feature(overflow.key(slot)), overflow[slot]);
+
+    weights.allocate(compacted.size(), init_weight);
+    std::copy(compacted.begin(), compacted.end(), weights.data());
+    overflow = compacted_overflow;
+    std::cout << "Compacted to radix " << tile_radix << ": kept " << kept << ", pruned " << pruned << " entries, "
+              << overflow.size() << " in overflow, " << weights.size() * sizeof(Weight) / (1 << 20) << " MB\n";
+    return;
+}
+
+// Read-only copies of the tables per NUMA node for multi-socket players, see WeightStorage
+bool NTupleTD::replicate_weights_numa()
+{
+    return weights.replicate_numa();
+}
+
+// Takes a private copy of the weights of an agent on the same patterns, e.g. a frozen snapshot
+void NTupleTD::copy_weights(const NTupleTD& source)
+{
+    if(source.patterns != patterns || source.board_size != board_size)
+        throw std::invalid_argument("Cannot copy weights between different patterns");
+    init_value = source.init_value;
+    const size_t table_size = set_tile_radix(source.tile_radix);
+    if(weights.is_read_only() || weights.is_reserved() || weights.size() != table_size)
+        weights.allocate(table_size, static_cast<Weight>(init_value));
+    std::copy(source.weights.data(), source.weights.data() + table_size, weights.data());
+    overflow = source.overflow;
+    return;
+}
+
+// Size and contents of the dense tables, as laid out for bind_weights
+size_t NTupleTD::weight_count() const
+{
+    return weights.size();
+}
+
+const Weight* NTupleTD::weight_data() const
+{
+    return weights.data();
+}
+
+/*
+ * Bounds of cal_value over every board: each tuple adds one entry of its
+ * pattern's table (dense or overflow, unseen overflow features read
+ * init_value), so the sum of every tuple's smallest and largest entries bound
+ * the value. Scans all weights; search engines compute it once.
+ */
+void NTupleTD::value_bounds(double& lower, double& upper) const
+{
+    std::vector<double> pattern_min(patterns.size(), init_value), pattern_max(patterns.size(), init_value);
+    for(int i = 0; i < patterns.size(); i++) {
+        const size_t table_size = pattern_table_size(patterns[i]);
+        const Weight* table = weights.data() + table_offsets[i];
+        for(size_t index = 0; index < table_size; index++) {
+            pattern_min[i] = std::min<double>(pattern_min[i], table[index]);
+            pattern_max[i] = std::max<double>(pattern_max[i], table[index]);
+        }
+    }
+    for(size_t slot = 1; slot <= overflow.size(); slot++) {
+        const int i = overflow_pattern(overflow.key(slot));
+        pattern_min[i] = std::min<double>(pattern_min[i], overflow[slot]);
+        pattern_max[i] = std::max<double>(pattern_max[i], overflow[slot]);
+    }
+    lower = upper = 0;
+    for(int index = 0; index < n_tuples; index++) {
+        lower += pattern_min[index / 8];
+        upper += pattern_max[index / 8];
+    }
+    return;
+}
+
+/*
+ * Reads and trains the dense tables in region from now on, which must hold
+ * weight_count() entries laid out like this agent's (e.g. a copy of
+ * weight_data()). The region stays owned by the caller. Overflow entries
+ * remain private to the agent.
+ */
+void NTupleTD::bind_weights(Weight* region)
+{
+    weights.borrow(region, weights.size());
+    return;
+}
+
 Pattern pattern_rot90(const Pattern& pattern, const int board_size)
 {
     Pattern rotated;
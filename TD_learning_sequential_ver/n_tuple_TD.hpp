@@ -2,35 +2,43 @@
 #define N_TUPLE_TD_HPP
 
 #include "2048env.hpp"
-#include <unordered_map>
+#include "bitboard.hpp"
+#include "n_tuple_patterns.hpp"
+#include "weight_storage.hpp"
+#include <cstddef>
 #include <utility>
 #include <string>
+#include <functional>
+
+#define MAX_BOARD_CELLS 64
+#define MAX_TUPLES 256
+#define TILE_BITS 4         // Each tuple cell is stored as a 4-bit tile exponent (0..15)
+#define OVERFLOW_CELL_BITS 6        // Exponent bits per cell in an overflow key
+#define MAX_OVERFLOW_CELLS 9        // Cells per pattern an overflow key can hold
+#define VALUE_PREFETCH_WINDOW 4     // Boards cal_values keeps prefetched ahead of the one it sums
 
 typedef std::pair<int, int> Coordinate;
 typedef std::vector<Coordinate> Pattern;
 
 typedef std::vector<int> Feature;
-typedef std::unordered_map<Feature, double> WeightsMap;
-
-namespace std {
-    template <>
-    struct hash<std::vector<int>> {
-        size_t operator()(const std::vector<int>& v) const {
-            size_t h = 0;
-            for (int x : v)
-                h ^= std::hash<int>{}(x) + 0x9e3779b9 + (h << 6) + (h >> 2);  // boost hash_combine
-            return h;
-        }
-    };
-}
 
+/*
+ * One step of an episode in the training buffer: the state the step learns on
+ * as 4-bit tile exponents, cell k at bits 4 * k, with bit k of high_cells
+ * adding 16 to cell k's exponent (tiles above 32768), then the reward that
+ * followed and whether the step ended the game. A truncated step is the last
+ * one recorded of a game that went on, it has no next state and no target.
+ * Boards up to 4x4.
+ */
 typedef struct {
-    Board beforestate;
-    int action;
-    int reward;
-    Board afterstate;
+    uint64_t cells;
+    uint16_t high_cells;
     bool done;
-} Experience;
+    bool truncated;
+    int reward;
+} PackedStep;
+
+#define PACKED_STEP_CELLS 16
 
 class NTupleTD
 {
@@ -41,27 +49,85 @@ class NTupleTD
         double learning_rate;
         double discount_factor;
         double init_value;
+        double lambda;                              // TD(lambda) decay, 0 keeps one-step TD
+        int trace_window;                           // Steps covered by the truncated lambda-return
+        double restart_probability;                 // Chance an episode starts from start_pool instead of reset()
+        std::vector<int> capture_tiles;             // Tiles whose first appearance in an episode records the board
+        int pool_capacity;
+        int pool_next;                              // Oldest board of a full pool, replaced next
+        std::vector<Board> start_pool;
+        std::function<void(const NTupleTD&, int)> checkpoint_callback;  // Called after each saved checkpoint
+        bool checkpointing;                         // train() logs scores and saves weights, off in worker processes
         std::vector<Pattern> patterns;
         std::vector<Pattern> symmetric_patterns;
-        std::vector<WeightsMap> weights;
+        bool static_patterns;                       // Patterns match DEFAULT_PATTERNS, use the unrolled evaluator
+        int tile_radix;                             // Tile exponents per tuple cell, 16 unless compacted
+        std::vector<std::vector<int>> tuple_cells;  // Flattened cell positions of each symmetric pattern
+        std::vector<size_t> tuple_offsets;          // Start of the owning pattern's table in weights
+        std::vector<size_t> table_offsets;          // Start of each pattern's table in weights
+        WeightStorage weights;                      // Dense tables, one tile_radix^n block per pattern
+        OverflowTable overflow;                     // Features with an exponent >= tile_radix, index weights.size() + slot
+        std::vector<PackedStep> trajectory;         // Steps of the current episode, reused between episodes
+        std::vector<double> next_values;            // Updated afterstate value of each step seen by the backward sweep
 
         std::vector<Pattern> generate_symmetric_patterns(const Pattern& pattern) const;
+        size_t set_tile_radix(const int tile_radix);
+        size_t pattern_table_size(const Pattern& pattern) const;
+        size_t encode_feature(const Feature& feature) const;
+        Feature decode_feature(size_t index, const int size) const;
         int tile_to_index(const int tile) const;
-        Feature get_feature(const Board& board, const Pattern pattern) const;
-        void update_weights(const Board& board, const double delta);
+        int get_exponents(const Board& board, int* exponents) const;
+        void training_feature_indices(const int* exponents, const int max_exponent, size_t* indices);
+        PackedStep pack_board(const Board& board) const;
+        int unpack_exponents(const PackedStep& step, int* exponents) const;
+        bool exponent_feature_indices(const int* exponents, const int max_exponent, size_t* indices) const;
+        uint64_t overflow_key(const int pattern_index, const int* feature, const int size) const;
+        uint64_t tuple_overflow_key(const int tuple_index, const int* exponents) const;
+        int overflow_pattern(const uint64_t key) const;
+        Feature overflow_feature(const uint64_t key) const;
+        double sum_weights(const Weight* table, const size_t* indices, const bool has_overflow) const;
+        int bitboard_max_exponent(const int* exponents) const;
+        bool prefetch_weights(const Weight* table, const BitBoard board, size_t* indices) const;
+        Weight& weight_ref(const size_t index);
+        void allocate_reserved_weights();
+        int index_multiplicity(const size_t* indices) const;
         double simulate_action(Env2048 env, const Board& board, const int action);
-        void learn(const Experience& experience);
+        double learn(const size_t* indices, const double target, double* error = nullptr);
+        bool map_weights_image(const std::string& path);
+        double lambda_target(const int step) const;
+        int start_episode(Env2048& env, bool& restarted);
+        void capture_start(const Board& board);
 
     public:
         NTupleTD(std::vector<Pattern>& patterns, int n_actions = 4, int board_size = 4, double init_value = 0.0, double learning_rate = 0.01, double discount_factor = 0.99);
+        void set_lambda(const double lambda, const int trace_window);
+        void set_checkpointing(const bool enabled);
+        void set_checkpoint_callback(const std::function<void(const NTupleTD&, int)>& callback);
+        void set_curriculum(const double restart_probability, const std::vector<int>& capture_tiles = {2048, 8192}, const int pool_capacity = 1000);
         std::vector<int> train(Env2048& env, const int episodes = 10000, const double epsilon = 0.1);
+        double regress(const Board& afterstate, const double target, double* updated_value = nullptr);
+        double regress(const PackedStep& step, const double target, double* updated_value = nullptr);
         double cal_value(const Board& board) const;
+        double cal_value(const PackedStep& step) const;
+        void cal_values(const BitBoard* boards, const int n_boards, double* values) const;
         int choose_action(Env2048& env, const double epsilon = 0.1);
+        int choose_action(const BitBoard board, const double epsilon = 0.1, double* best_value = nullptr) const;
         void save_scores(const std::string& path, const std::vector<int>& scores) const;
         void save_weights(const std::string& path) const;
         void load_weights(const std::string& path);
+        void save_weights_image(const std::string& path) const;
+        bool attach_weights(const std::string& image_path, const std::string& text_path);
+        bool replicate_weights_numa();
+        void copy_weights(const NTupleTD& source);
+        size_t weight_count() const;
+        const Weight* weight_data() const;
+        void value_bounds(double& lower, double& upper) const;
+        void bind_weights(Weight* region);
+        void analyze_weights(const double epsilon) const;
+        void compact_weights(const double epsilon, const int tile_radix);
 };
 
+std::vector<Pattern> default_patterns();
 Pattern pattern_rot90(const Pattern& pattern, const int board_size);
 Pattern pattern_reflect(const Pattern& pattern, const int board_size);
 
@@ -0,0 +1,93 @@
+#ifndef N_TUPLE_PATTERNS_HPP
+#define N_TUPLE_PATTERNS_HPP
+
+#include <cstddef>
+#include <utility>
+
+/*
+ * Compile-time copy of the production pattern set (8 patterns of 6 cells on
+ * the 4x4 board). The symmetric tuples are generated by constexpr code in
+ * the same order as NTupleTD::generate_symmetric_patterns, so the evaluator
+ * below unrolls all 64 index computations with constant cell positions and
+ * table offsets. The runtime path in NTupleTD stays for other pattern sets.
+ */
+
+#define DEFAULT_N_PATTERNS 8
+#define DEFAULT_TUPLE_SIZE 6
+#define DEFAULT_BOARD_SIZE 4
+#define DEFAULT_N_TUPLES (DEFAULT_N_PATTERNS * 8)
+
+constexpr int DEFAULT_PATTERNS[DEFAULT_N_PATTERNS][DEFAULT_TUPLE_SIZE][2] = {
+    {{0, 0}, {0, 1}, {0, 2}, {1, 0}, {1, 1}, {1, 2}},
+    {{0, 1}, {0, 2}, {1, 1}, {1, 2}, {2, 1}, {3, 1}},
+    {{0, 0}, {1, 0}, {2, 0}, {3, 0}, {0, 1}, {1, 1}},
+    {{0, 0}, {0, 1}, {1, 1}, {1, 2}, {1, 3}, {2, 2}},
+    {{0, 0}, {0, 1}, {0, 2}, {1, 1}, {2, 1}, {2, 2}},
+    {{0, 0}, {0, 1}, {1, 1}, {2, 1}, {3, 1}, {3, 2}},
+    {{0, 0}, {0, 1}, {1, 1}, {2, 0}, {2, 1}, {3, 1}},
+    {{0, 0}, {0, 1}, {0, 2}, {1, 0}, {1, 2}, {2, 2}}
+};
+
+struct StaticTuples {
+    int cells[DEFAULT_N_TUPLES][DEFAULT_TUPLE_SIZE];  // Flattened cell position y * 4 + x
+};
+
+constexpr StaticTuples make_default_tuples()
+{
+    StaticTuples tuples = {};
+    for (int p = 0; p < DEFAULT_N_PATTERNS; p++) {
+        int ys[DEFAULT_TUPLE_SIZE] = {}, xs[DEFAULT_TUPLE_SIZE] = {};
+        for (int k = 0; k < DEFAULT_TUPLE_SIZE; k++) {
+            ys[k] = DEFAULT_PATTERNS[p][k][0];
+            xs[k] = DEFAULT_PATTERNS[p][k][1];
+        }
+        for (int r = 0; r < 4; r++) {
+            for (int k = 0; k < DEFAULT_TUPLE_SIZE; k++) {
+                tuples.cells[p * 8 + r * 2][k] = ys[k] * DEFAULT_BOARD_SIZE + xs[k];
+                tuples.cells[p * 8 + r * 2 + 1][k] = ys[k] * DEFAULT_BOARD_SIZE + (DEFAULT_BOARD_SIZE - 1 - xs[k]);
+            }
+            for (int k = 0; k < DEFAULT_TUPLE_SIZE; k++) {
+                const int y = ys[k];
+                ys[k] = xs[k];
+                xs[k] = DEFAULT_BOARD_SIZE - 1 - y;
+            }
+        }
+    }
+    return tuples;
+}
+
+inline constexpr StaticTuples DEFAULT_TUPLES = make_default_tuples();
+inline constexpr size_t DEFAULT_TABLE_SIZE = static_cast<size_t>(1) << (4 * DEFAULT_TUPLE_SIZE);
+
+template <size_t T, size_t... K>
+inline size_t default_feature_index(const int* exponents, std::index_sequence<K...>)
+{
+    return (T / 8) * DEFAULT_TABLE_SIZE
+         + ((static_cast<size_t>(exponents[DEFAULT_TUPLES.cells[T][K]]) << (4 * K)) | ...);
+}
+
+template <size_t... T>
+inline void default_feature_indices(const int* exponents, size_t* indices, std::index_sequence<T...>)
+{
+    ((indices[T] = default_feature_index<T>(exponents, std::make_index_sequence<DEFAULT_TUPLE_SIZE>{})), ...);
+}
+
+template <typename W, size_t... T>
+inline double default_value(const W* weights, const int* exponents, std::index_sequence<T...>)
+{
+    return (0.0 + ... + static_cast<double>(weights[default_feature_index<T>(exponents, std::make_index_sequence<DEFAULT_TUPLE_SIZE>{})]));
+}
+
+// Feature indices of all 64 symmetric tuples into the concatenated pattern tables
+inline void default_feature_indices(const int* exponents, size_t* indices)
+{
+    default_feature_indices(exponents, indices, std::make_index_sequence<DEFAULT_N_TUPLES>{});
+}
+
+template <typename W>
+inline double default_value(const W* weights, const int* exponents)
+{
+    return default_value(weights, exponents, std::make_index_sequence<DEFAULT_N_TUPLES>{});
+}
+
+#endif
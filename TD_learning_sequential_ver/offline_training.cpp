@@ -0,0 +1,97 @@
+#include "n_tuple_TD.hpp"
+#include "game_record.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+/*
+ * Usage: TD_learning_offline.exe <games.bin> [epochs] [td|mc] [block_steps]
+ * Trains 2048_weights.pkl on recorded games instead of fresh episodes. Each
+ * epoch visits the steps in blocks of block_steps consecutive records, in a
+ * new random block order, so reads stay sequential within a block. Inside a
+ * block the steps are swept backwards as in train(). td regresses every state
+ * on reward + V(next state), mc on the return of the rest of its game.
+ * Truncated steps have no next state and are skipped, and so are all steps
+ * of a truncated game for mc, whose returns are unknown.
+ */
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <games.bin> [epochs] [td|mc] [block_steps]\n";
+        return 1;
+    }
+    const int epochs = (argc > 2) ? std::atoi(argv[2]) : 10;
+    const bool monte_carlo = (argc > 3) && std::string(argv[3]) == "mc";
+    const size_t block_steps = (argc > 4) ? std::atol(argv[4]) : 4096;
+    if (block_steps == 0) {
+        std::cerr << "block_steps must be positive\n";
+        return 1;
+    }
+
+    GameDataset dataset;
+    if (!dataset.open(argv[1]))
+        return 1;
+    std::vector<Pattern> patterns = default_patterns();
+    NTupleTD agent(patterns, 4, 4, 0, 0.01, 1.0);
+    agent.load_weights("2048_weights.pkl");
+
+    // Monte-Carlo targets are fixed, computed once backwards over the whole file (NaN: none)
+    std::vector<double> returns;
+    if (monte_carlo) {
+        returns.resize(dataset.size());
+        double future = 0;
+        bool complete = true;
+        for (size_t i = dataset.size(); i-- > 0;) {
+            if (dataset[i].done || dataset[i].truncated) {
+                future = 0;
+                complete = dataset[i].done;
+            }
+            future += dataset[i].reward;
+            returns[i] = complete ? future : std::nan("");
+        }
+    }
+
+    const size_t n_blocks = (dataset.size() + block_steps - 1) / block_steps;
+    std::vector<size_t> order(n_blocks);
+    std::iota(order.begin(), order.end(), 0);
+    std::mt19937 rng(2048);
+    std::cout << "Training on " << dataset.size() << " recorded steps, " << n_blocks << " blocks, "
+              << (monte_carlo ? "Monte-Carlo" : "TD") << " targets\n";
+    for (int epoch = 1; epoch <= epochs; epoch++) {
+        std::shuffle(order.begin(), order.end(), rng);
+        double squared_error = 0;
+        size_t n_trained = 0;
+        for (size_t b = 0; b < n_blocks; b++) {
+            if (b + 1 < n_blocks)
+                dataset.prefetch(order[b + 1] * block_steps, block_steps);
+            const size_t start = order[b] * block_steps;
+            const size_t end = std::min(start + block_steps, dataset.size());
+            // As in train(), the updated value of step i + 1 is the next value of step i,
+            // so only the step after the block is evaluated separately
+            double next_value = (!monte_carlo && end < dataset.size()) ? agent.cal_value(dataset[end]) : 0;
+            for (size_t i = end; i-- > start;) {
+                const PackedStep& step = dataset[i];
+                if (step.truncated || (monte_carlo && std::isnan(returns[i]))) {
+                    next_value = monte_carlo ? 0 : agent.cal_value(step);
+                    continue;
+                }
+                double target;
+                if (monte_carlo)
+                    target = returns[i];
+                else
+                    target = step.reward + ((step.done || i + 1 == dataset.size()) ? 0 : next_value);
+                const double error = agent.regress(step, target, &next_value);
+                squared_error += error * error;
+                n_trained++;
+            }
+        }
+        std::cout << "Epoch: " << epoch << ", RMSE: " << std::sqrt(squared_error / std::max<size_t>(n_trained, 1)) << "\n";
+        agent.save_weights("2048_weights.pkl");
+    }
+    return 0;
+}
@@ -4,22 +4,15 @@
 
 int main(void)
 {
-    std::vector<Pattern> patterns = {
-        {{0, 0}, {0, 1}, {0, 2}, {1, 0}, {1, 1}, {1, 2}},
-        {{0, 1}, {0, 2}, {1, 1}, {1, 2}, {2, 1}, {3, 1}},
-        {{0, 0}, {1, 0}, {2, 0}, {3, 0}, {0, 1}, {1, 1}},
-        {{0, 0}, {0, 1}, {1, 1}, {1, 2}, {1, 3}, {2, 2}},
-        {{0, 0}, {0, 1}, {0, 2}, {1, 1}, {2, 1}, {2, 2}},
-        {{0, 0}, {0, 1}, {1, 1}, {2, 1}, {3, 1}, {3, 2}},
-        {{0, 0}, {0, 1}, {1, 1}, {2, 0}, {2, 1}, {3, 1}},
-        {{0, 0}, {0, 1}, {0, 2}, {1, 0}, {1, 2}, {2, 2}}
-    };
+    std::vector<Pattern> patterns = default_patterns();
     
     NTupleTD agent(patterns);
     Env2048 env;
     env.reset();
     
-    agent.load_weights("2048_weights.pkl");
+    agent.attach_weights("2048_weights.bin", "2048_weights.pkl");
+    // Or the table distilled from expectimax (expectimax_search/Distill.exe):
+    // agent.attach_weights("2048_distilled_weights.bin", "2048_distilled_weights.pkl");
     while(true) {
         int action = agent.choose_action(env, 0);
 
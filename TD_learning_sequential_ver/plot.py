@@ -1,11 +1,47 @@
+import os
 import matplotlib.pyplot as plt
 
 if __name__ == "__main__":
     with open("2048_scores.txt", "r") as file:
         scores = [int(line.strip()) for line in file.readlines()]
-    plt.plot(scores, marker='o', linestyle='-', color='b')
-    plt.title("2048 Game Scores Over Time")
-    plt.xlabel("Game Number")
-    plt.ylabel("Score")
-    plt.grid(True)
-    plt.show()
\ No newline at end of file
+
+    # Checkpoint evaluations written by the trainer: episode player games mean_score tile rates...
+    evaluations = {}
+    if os.path.exists("2048_eval.txt"):
+        with open("2048_eval.txt", "r") as file:
+            for line in file:
+                if line.startswith("#") or not line.strip():
+                    continue
+                fields = line.split()
+                evaluations.setdefault(fields[1], []).append((int(fields[0]), float(fields[3]), float(fields[4])))
+
+    if not evaluations:
+        plt.plot(scores, marker='o', linestyle='-', color='b')
+        plt.title("2048 Game Scores Over Time")
+        plt.xlabel("Game Number")
+        plt.ylabel("Score")
+        plt.grid(True)
+        plt.show()
+    else:
+        fig, (ax_scores, ax_eval) = plt.subplots(2, 1, figsize=(8, 8))
+        ax_scores.plot(scores, marker='o', linestyle='-', color='b')
+        ax_scores.set_title("2048 Game Scores Over Time")
+        ax_scores.set_xlabel("Game Number")
+        ax_scores.set_ylabel("Score")
+        ax_scores.grid(True)
+
+        ax_rate = ax_eval.twinx()
+        for player, color in zip(sorted(evaluations), ['#4C72B0', '#C44E52', '#55A868']):
+            episodes, means, rates = zip(*evaluations[player])
+            ax_eval.plot(episodes, means, marker='o', linestyle='-', color=color, label=player + " mean score")
+            ax_rate.plot(episodes, rates, linestyle='--', color=color, label=player + " 2048 rate")
+        ax_eval.set_title("Checkpoint Evaluation")
+        ax_eval.set_xlabel("Episode")
+        ax_eval.set_ylabel("Mean Score")
+        ax_rate.set_ylabel("2048 Rate")
+        ax_rate.set_ylim(0, 1)
+        ax_eval.legend(loc='upper left')
+        ax_rate.legend(loc='lower right')
+        ax_eval.grid(True)
+        plt.tight_layout()
+        plt.show()
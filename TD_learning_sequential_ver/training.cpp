@@ -1,24 +1,23 @@
 #include "n_tuple_TD.hpp"
+#include "evaluator.hpp"
 #include <iostream>
 
 int main(void)
 {
-    std::vector<Pattern> patterns = {
-        {{0, 0}, {0, 1}, {0, 2}, {1, 0}, {1, 1}, {1, 2}},
-        {{0, 1}, {0, 2}, {1, 1}, {1, 2}, {2, 1}, {3, 1}},
-        {{0, 0}, {1, 0}, {2, 0}, {3, 0}, {0, 1}, {1, 1}},
-        {{0, 0}, {0, 1}, {1, 1}, {1, 2}, {1, 3}, {2, 2}},
-        {{0, 0}, {0, 1}, {0, 2}, {1, 1}, {2, 1}, {2, 2}},
-        {{0, 0}, {0, 1}, {1, 1}, {2, 1}, {3, 1}, {3, 2}},
-        {{0, 0}, {0, 1}, {1, 1}, {2, 0}, {2, 1}, {3, 1}},
-        {{0, 0}, {0, 1}, {0, 2}, {1, 0}, {1, 2}, {2, 2}}
-    };
+    std::vector<Pattern> patterns = default_patterns();
     
     // For OI approach, considering set the init_value to 160000
     NTupleTD agent(patterns, 4, 4, 0, 0.01, 1.0);
+    // TD(lambda) over a truncated window, e.g. agent.set_lambda(0.5, 5);
+    // Start part of the episodes from recorded late-game boards, e.g. agent.set_curriculum(0.5);
     Env2048 env;
     
     agent.load_weights("2048_weights.pkl");
+    // Measures every saved checkpoint on a spare thread, results in 2048_eval.txt
+    CheckpointEvaluator evaluator(patterns);
+    agent.set_checkpoint_callback([&evaluator](const NTupleTD& trained, int episode) {
+        evaluator.submit(trained, episode);
+    });
     std::vector<int> scores = agent.train(env, 1000000, 0.1);
     std::cout << "Training completed.\n";
 
@@ -0,0 +1,391 @@
+#include "weight_storage.hpp"
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+static const size_t SMALL_PAGE = 4096;
+static const size_t HUGE_PAGE_2MB = size_t(1) << 21;
+static const size_t HUGE_PAGE_1GB = size_t(1) << 30;
+
+thread_local int current_numa_node = -1;
+
+namespace {
+
+std::atomic<bool> numa_replication(false);
+
+// CPUs of a node from /sys/devices/system/node/nodeN/cpulist ("0-7,16-23")
+std::vector<int> numa_node_cpus(const int node)
+{
+    std::vector<int> cpus;
+    std::ifstream ifs("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string range;
+    while (std::getline(ifs, range, ',')) {
+        int first = 0, last = 0;
+        char dash = 0;
+        std::istringstream iss(range);
+        if (!(iss >> first))
+            continue;
+        last = (iss >> dash >> last) ? last : first;
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+bool pin_to_cpus(const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+    return !cpus.empty() && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+}
+
+// madvise(MADV_HUGEPAGE) succeeds even when THP is "never", only the sysfs mode tells
+static bool transparent_huge_pages_enabled()
+{
+    std::ifstream ifs("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string modes;
+    std::getline(ifs, modes);
+    return modes.find("[always]") != std::string::npos || modes.find("[madvise]") != std::string::npos;
+}
+
+static size_t round_up(const size_t bytes, const size_t page)
+{
+    return (bytes + page - 1) / page * page;
+}
+
+/*
+ * Anonymous writable memory for at least bytes, trying in order explicit 1 GB
+ * and 2 MB pages from the hugetlbfs pool (only when the region fills at least
+ * one page), then transparent huge pages on a 2 MB aligned region, then plain
+ * pages. page_size is the size obtained; transparent huge pages count only
+ * when the kernel has them enabled, and it may still back part of the region
+ * with small pages.
+ */
+void* allocate_pages(const size_t bytes, size_t& mapped_bytes, size_t& page_size)
+{
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    const size_t explicit_pages[2] = {HUGE_PAGE_1GB, HUGE_PAGE_2MB};
+    const int explicit_flags[2] = {MAP_HUGE_1GB, MAP_HUGE_2MB};
+    for (int i = 0; i < 2; i++) {
+        if (bytes < explicit_pages[i])
+            continue;
+        mapped_bytes = round_up(bytes, explicit_pages[i]);
+        void* region = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB | explicit_flags[i], -1, 0);
+        if (region != MAP_FAILED) {
+            page_size = explicit_pages[i];
+            return region;
+        }
+    }
+
+    // Over-map by one huge page so the table can start on a 2 MB boundary
+    mapped_bytes = round_up(std::max<size_t>(bytes, 1), SMALL_PAGE);
+    page_size = SMALL_PAGE;
+    if (bytes < HUGE_PAGE_2MB) {
+        void* region = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+        return region == MAP_FAILED ? nullptr : region;
+    }
+    mapped_bytes = round_up(bytes, HUGE_PAGE_2MB);
+    void* raw = mmap(nullptr, mapped_bytes + HUGE_PAGE_2MB, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (raw == MAP_FAILED)
+        return nullptr;
+    char* start = static_cast<char*>(raw);
+    char* aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<size_t>(start), HUGE_PAGE_2MB));
+    if (aligned > start)
+        munmap(start, aligned - start);
+    if (aligned < start + HUGE_PAGE_2MB)
+        munmap(aligned + mapped_bytes, start + HUGE_PAGE_2MB - aligned);
+#ifdef MADV_HUGEPAGE
+    if (madvise(aligned, mapped_bytes, MADV_HUGEPAGE) == 0 && transparent_huge_pages_enabled())
+        page_size = HUGE_PAGE_2MB;
+#endif
+    return aligned;
+}
+
+std::string page_size_name(const size_t page_size)
+{
+    if (page_size >= HUGE_PAGE_1GB)
+        return "1 GB huge pages";
+    if (page_size >= HUGE_PAGE_2MB)
+        return "2 MB huge pages";
+    return std::to_string(page_size / 1024) + " KB pages";
+}
+
+int numa_node_count()
+{
+    int nodes = 0;
+    while (!numa_node_cpus(nodes).empty())
+        nodes++;
+    return std::max(nodes, 1);
+}
+
+/*
+ * Pins a worker thread to one core, spreading consecutive workers over the
+ * NUMA nodes, and records its node so WeightStorage::read_table() returns
+ * the local replica. Does nothing unless replicate_numa() succeeded.
+ */
+void numa_pin_thread(const int worker)
+{
+    if (!numa_replication.load())
+        return;
+    const int nodes = numa_node_count();
+    const int node = worker % nodes;
+    const std::vector<int> cpus = numa_node_cpus(node);
+    if (cpus.empty())
+        return;
+    if (pin_to_cpus({cpus[(worker / nodes) % cpus.size()]}))
+        current_numa_node = node;
+    return;
+}
+
+WeightStorage::WeightStorage()
+    : table(nullptr), n_weights(0), mapping(nullptr), mapping_bytes(0),
+      file_backed(false), reserved(false), page_size(0)
+{
+}
+
+WeightStorage::~WeightStorage()
+{
+    release();
+}
+
+void WeightStorage::allocate(const size_t n_weights, const Weight init_value)
+{
+    release();
+    size_t bytes = 0, page = 0;
+    void* region = allocate_pages(n_weights * sizeof(Weight), bytes, page);
+    if (region == nullptr)
+        throw std::bad_alloc();
+    mapping = region;
+    mapping_bytes = bytes;
+    page_size = page;
+    table = static_cast<Weight*>(region);
+    this->n_weights = n_weights;
+    std::fill(table, table + n_weights, init_value);
+
+    static size_t reported_page = 0;
+    if (page != reported_page && n_weights * sizeof(Weight) >= HUGE_PAGE_2MB) {
+        std::cout << "Weight tables: " << (n_weights * sizeof(Weight) >> 20) << " MB on " << page_size_name(page) << "\n";
+        reported_page = page;
+    }
+    return;
+}
+
+/*
+ * Stands in for n_weights zeros without committing memory or taking huge
+ * pages from the pool: reads of a read-only anonymous mapping all hit the
+ * kernel's zero page. A player that attaches a weight image never pays for a
+ * private table; a writer allocates first (is_reserved).
+ */
+void WeightStorage::reserve(const size_t n_weights)
+{
+    release();
+    const size_t bytes = round_up(std::max<size_t>(n_weights * sizeof(Weight), 1), SMALL_PAGE);
+    void* region = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED)
+        throw std::bad_alloc();
+    mapping = region;
+    mapping_bytes = bytes;
+    reserved = true;
+    page_size = SMALL_PAGE;
+    table = static_cast<Weight*>(region);
+    this->n_weights = n_weights;
+    return;
+}
+
+// Maps n_weights entries starting at offset (page aligned) of path, read-only and shared
+bool WeightStorage::map_file(const std::string& path, const size_t offset, const size_t n_weights)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error opening weight image: " << path << "\n";
+        return false;
+    }
+    struct stat st;
+    const size_t bytes = offset + n_weights * sizeof(Weight);
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < bytes) {
+        std::cerr << "Weight image is truncated: " << path << "\n";
+        close(fd);
+        return false;
+    }
+    void* region = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        std::cerr << "Error mapping weight image: " << path << "\n";
+        return false;
+    }
+    madvise(region, bytes, MADV_WILLNEED);
+
+    release();
+    mapping = region;
+    mapping_bytes = bytes;
+    file_backed = true;
+    page_size = SMALL_PAGE;
+    table = reinterpret_cast<Weight*>(static_cast<char*>(region) + offset);
+    this->n_weights = n_weights;
+    return true;
+}
+
+// Uses region, owned by the caller, as the writable tables; release() leaves it alone
+void WeightStorage::borrow(Weight* region, const size_t n_weights)
+{
+    release();
+    table = region;
+    this->n_weights = n_weights;
+    return;
+}
+
+/*
+ * Copies the tables once per NUMA node. Each copy is written by a thread bound
+ * to that node, so first-touch places its pages in local memory. The tables
+ * become read-only: training keeps a single writable image.
+ */
+bool WeightStorage::replicate_numa()
+{
+    const int nodes = numa_node_count();
+    if (nodes <= 1 || table == nullptr || !replicas.empty())
+        return false;
+
+    const size_t bytes = n_weights * sizeof(Weight);
+    // Each node's huge page pool differs, so every copy keeps the length it was mapped with
+    std::vector<size_t> lengths(nodes, 0);
+    std::vector<Weight*> copies(nodes, nullptr);
+    std::vector<std::thread> writers;
+    for (int node = 0; node < nodes; node++) {
+        writers.emplace_back([this, node, bytes, &copies, &lengths] {
+            pin_to_cpus(numa_node_cpus(node));
+            size_t region_bytes = 0, page = 0;
+            void* region = allocate_pages(bytes, region_bytes, page);
+            if (region == nullptr)
+                return;
+            std::memcpy(region, table, bytes);
+            mprotect(region, region_bytes, PROT_READ);
+            lengths[node] = region_bytes;
+            copies[node] = static_cast<Weight*>(region);
+        });
+    }
+    for (std::thread& writer : writers)
+        writer.join();
+
+    for (Weight* copy : copies) {
+        if (copy == nullptr) {
+            std::cerr << "NUMA replication failed, keeping a single weight image\n";
+            for (int node = 0; node < nodes; node++)
+                if (copies[node] != nullptr)
+                    munmap(copies[node], lengths[node]);
+            return false;
+        }
+    }
+    replicas = copies;
+    replica_lengths = lengths;
+    numa_replication.store(true);
+    std::cout << "Weights replicated on " << nodes << " NUMA nodes\n";
+    return true;
+}
+
+void WeightStorage::release()
+{
+    for (size_t i = 0; i < replicas.size(); i++)
+        munmap(replicas[i], replica_lengths[i]);
+    replicas.clear();
+    replica_lengths.clear();
+    if (mapping != nullptr)
+        munmap(mapping, mapping_bytes);
+    mapping = nullptr;
+    mapping_bytes = 0;
+    file_backed = false;
+    reserved = false;
+    page_size = 0;
+    table = nullptr;
+    n_weights = 0;
+    return;
+}
+
+void WeightStorage::fill(const Weight value)
+{
+    std::fill(table, table + n_weights, value);
+    return;
+}
+
+OverflowTable::OverflowTable()
+{
+    reset(0);
+}
+
+void OverflowTable::reset(const Weight init_value)
+{
+    bucket_keys.assign(1024, 0);
+    bucket_slots.assign(1024, 0);
+    keys.assign(1, 0);
+    values.assign(1, init_value);
+    return;
+}
+
+size_t OverflowTable::bucket(const uint64_t key) const
+{
+    return (key * 0x9E3779B97F4A7C15ULL) >> 32 & (bucket_keys.size() - 1);
+}
+
+// Slot of key, 0 (the init_value slot) if the feature was never inserted
+size_t OverflowTable::find(const uint64_t key) const
+{
+    for (size_t b = bucket(key);; b = (b + 1) & (bucket_keys.size() - 1)) {
+        if (bucket_keys[b] == key)
+            return bucket_slots[b];
+        if (bucket_keys[b] == 0)
+            return 0;
+    }
+}
+
+size_t OverflowTable::insert(const uint64_t key)
+{
+    size_t b = bucket(key);
+    for (; bucket_keys[b] != 0; b = (b + 1) & (bucket_keys.size() - 1))
+        if (bucket_keys[b] == key)
+            return bucket_slots[b];
+    bucket_keys[b] = key;
+    bucket_slots[b] = values.size();
+    keys.push_back(key);
+    values.push_back(values[0]);
+    if (2 * values.size() > bucket_keys.size())
+        grow();
+    return values.size() - 1;
+}
+
+void OverflowTable::grow()
+{
+    bucket_keys.assign(bucket_keys.size() * 2, 0);
+    bucket_slots.assign(bucket_keys.size(), 0);
+    for (size_t slot = 1; slot < keys.size(); slot++) {
+        size_t b = bucket(keys[slot]);
+        while (bucket_keys[b] != 0)
+            b = (b + 1) & (bucket_keys.size() - 1);
+        bucket_keys[b] = keys[slot];
+        bucket_slots[b] = slot;
+    }
+    return;
+}
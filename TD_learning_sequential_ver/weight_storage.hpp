@@ -0,0 +1,104 @@
+#ifndef WEIGHT_STORAGE_HPP
+#define WEIGHT_STORAGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef float Weight;
+
+extern thread_local int current_numa_node;   // Set by numa_pin_thread, -1 if not pinned
+
+/*
+ * Backing memory of the dense n-tuple tables. Either a private writable
+ * allocation (training) or a read-only mapping of a weight image file, which
+ * the kernel shares between every process that maps the same file.
+ * The tables can also live in memory owned by someone else (borrow), e.g. a
+ * shared segment of the multi-process trainer.
+ * Private allocations are placed on huge pages when the system allows it, as
+ * lookups are random over hundreds of MB and 4 KB pages miss the TLB.
+ * Readers go through read_table(), which returns the replica on the calling
+ * thread's NUMA node once replicate_numa() has copied the tables per node.
+ * Zero tables can be reserved instead of allocated: they read as zeros
+ * without committing memory, and must be allocated before the first write.
+ */
+class WeightStorage
+{
+    private:
+        Weight* table;
+        size_t n_weights;
+        void* mapping;
+        size_t mapping_bytes;
+        bool file_backed;
+        bool reserved;                              // Read-only zero mapping standing in for unwritten tables
+        size_t page_size;                           // Page size backing the tables, 0 if unknown
+        std::vector<Weight*> replicas;              // One read-only copy per NUMA node, empty if not replicated
+        std::vector<size_t> replica_lengths;        // Mapped length of each replica, pages differ per node
+
+    public:
+        WeightStorage();
+        ~WeightStorage();
+        WeightStorage(const WeightStorage&) = delete;
+        WeightStorage& operator=(const WeightStorage&) = delete;
+
+        void allocate(const size_t n_weights, const Weight init_value);
+        void reserve(const size_t n_weights);
+        bool map_file(const std::string& path, const size_t offset, const size_t n_weights);
+        void borrow(Weight* region, const size_t n_weights);
+        void release();
+        void fill(const Weight value);
+        bool replicate_numa();
+
+        bool is_read_only() const { return file_backed || !replicas.empty(); }
+        bool is_replicated() const { return !replicas.empty(); }
+        bool is_reserved() const { return reserved; }
+        size_t size() const { return n_weights; }
+        size_t get_page_size() const { return page_size; }
+        Weight* data() { return table; }
+        const Weight* data() const { return table; }
+        const Weight* read_table() const {
+            if (current_numa_node < 0 || current_numa_node >= static_cast<int>(replicas.size()))
+                return table;
+            return replicas[current_numa_node];
+        }
+        Weight& operator[](const size_t index) { return table[index]; }
+        const Weight& operator[](const size_t index) const { return table[index]; }
+};
+
+void* allocate_pages(const size_t bytes, size_t& mapped_bytes, size_t& page_size);
+std::string page_size_name(const size_t page_size);
+/*
+ * Weights of the rare features holding a tile exponent beyond the dense
+ * tables' radix. Open addressing with linear probing maps a packed feature key
+ * to a slot of an append-only value array, so slots stay valid while the
+ * buckets grow. Slot 0 holds init_value and stands for every unseen key; it is
+ * never written.
+ */
+class OverflowTable
+{
+    private:
+        std::vector<uint64_t> bucket_keys;          // 0 marks an empty bucket
+        std::vector<uint32_t> bucket_slots;
+        std::vector<uint64_t> keys;                 // Key of each slot
+        std::vector<Weight> values;
+
+        size_t bucket(const uint64_t key) const;
+        void grow();
+
+    public:
+        OverflowTable();
+        void reset(const Weight init_value);
+        size_t find(const uint64_t key) const;
+        size_t insert(const uint64_t key);
+
+        size_t size() const { return values.size() - 1; }
+        uint64_t key(const size_t slot) const { return keys[slot]; }
+        Weight& operator[](const size_t slot) { return values[slot]; }
+        const Weight& operator[](const size_t slot) const { return values[slot]; }
+};
+
+int numa_node_count();
+void numa_pin_thread(const int worker);
+
+#endif
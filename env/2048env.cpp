@@ -42,6 +42,30 @@ void Env2048::add_random_tile()
     return;
 }
 
+// Every board add_random_tile() can produce, with its probability
+std::vector<std::pair<Board, double>> Env2048::get_spawn_outcomes() const
+{
+    std::vector<std::pair<Board, double>> outcomes;
+    int n_empty = 0;
+    for(int i = 0; i < size; i++)
+        for(int j = 0; j < size; j++)
+            n_empty += (board[i][j] == 0);
+    if(n_empty == 0)
+        return outcomes;
+    outcomes.reserve(2 * n_empty);
+    for(int i = 0; i < size; i++) {
+        for(int j = 0; j < size; j++) {
+            if(board[i][j] != 0)
+                continue;
+            outcomes.emplace_back(board, 0.9 / n_empty);
+            outcomes.back().first[i][j] = 2;
+            outcomes.emplace_back(board, 0.1 / n_empty);
+            outcomes.back().first[i][j] = 4;
+        }
+    }
+    return outcomes;
+}
+
 Row Env2048::compress(const Row& row)
 {
     Row new_row;
@@ -2,6 +2,7 @@
 #define ENV2048_HPP
 
 #include <vector>
+#include <utility>
 
 typedef std::vector<std::vector<int>> Board;
 typedef std::vector<int> Row;
@@ -37,6 +38,7 @@ class Env2048
         void print_board() const;
 
         void add_random_tile();
+        std::vector<std::pair<Board, double>> get_spawn_outcomes() const;
         bool is_move_legal(const int action);
         std::vector<int> get_legal_actions();
         int get_size() const { return size; }
@@ -0,0 +1,141 @@
+#include "bitboard.hpp"
+
+namespace {
+
+struct RowTables {
+    uint16_t left[65536];
+    uint16_t right[65536];
+    int score[65536];
+
+    RowTables()
+    {
+        for (int row = 0; row < 65536; row++) {
+            int line[4], merged[4] = {0, 0, 0, 0};
+            for (int i = 0; i < 4; i++)
+                line[i] = (row >> (4 * i)) & 0xF;
+
+            // Same compress, merge, compress order as Env2048::move_left
+            int n = 0, reward = 0;
+            for (int i = 0; i < 4; i++)
+                if (line[i] != 0)
+                    merged[n++] = line[i];
+            for (int i = 0; i < 3; i++) {
+                if (merged[i] != 0 && merged[i] == merged[i + 1]) {
+                    merged[i]++;
+                    reward += 1 << merged[i];
+                    merged[i + 1] = 0;
+                }
+            }
+            int result[4] = {0, 0, 0, 0};
+            n = 0;
+            for (int i = 0; i < 4; i++)
+                if (merged[i] != 0)
+                    result[n++] = merged[i];
+
+            uint16_t packed = 0;
+            for (int i = 0; i < 4; i++)
+                packed |= static_cast<uint16_t>((result[i] & 0xF) << (4 * i));
+            left[row] = packed;
+            score[row] = reward;
+        }
+        for (int row = 0; row < 65536; row++) {
+            const int reversed = reverse_row(row);
+            right[row] = static_cast<uint16_t>(reverse_row(left[reversed]));
+        }
+    }
+
+    static int reverse_row(const int row)
+    {
+        return ((row & 0xF) << 12) | ((row & 0xF0) << 4) | ((row & 0xF00) >> 4) | ((row & 0xF000) >> 12);
+    }
+};
+
+const RowTables& row_tables()
+{
+    static const RowTables tables;
+    return tables;
+}
+
+// Applies the row table to every row of board, accumulating the merge reward
+int move_rows(const BitBoard board, const uint16_t* table, BitBoard& afterstate)
+{
+    const RowTables& tables = row_tables();
+    int reward = 0;
+    afterstate = 0;
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        const int row = static_cast<int>((board >> (16 * y)) & 0xFFFF);
+        afterstate |= static_cast<BitBoard>(table[row]) << (16 * y);
+        reward += tables.score[row];
+    }
+    return reward;
+}
+
+}
+
+bool to_bitboard(const Board& board, BitBoard& bitboard)
+{
+    if (board.size() != BITBOARD_SIZE)
+        return false;
+    bitboard = 0;
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        for (int x = 0; x < BITBOARD_SIZE; x++) {
+            const int tile = board[y][x];
+            if (tile == 0)
+                continue;
+            const int exponent = 31 - __builtin_clz(static_cast<unsigned int>(tile));
+            if (exponent > BITBOARD_MAX_EXPONENT)
+                return false;
+            bitboard |= static_cast<BitBoard>(exponent) << (4 * (y * BITBOARD_SIZE + x));
+        }
+    }
+    return true;
+}
+
+Board from_bitboard(const BitBoard bitboard)
+{
+    Board board(BITBOARD_SIZE, Row(BITBOARD_SIZE, 0));
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        for (int x = 0; x < BITBOARD_SIZE; x++) {
+            const int exponent = bitboard_exponent(bitboard, y * BITBOARD_SIZE + x);
+            board[y][x] = (exponent == 0) ? 0 : (1 << exponent);
+        }
+    }
+    return board;
+}
+
+int bitboard_move(const BitBoard board, const int action, BitBoard& afterstate)
+{
+    const RowTables& tables = row_tables();
+    int reward = 0;
+    switch(action) {
+        case Up:
+            reward = move_rows(bitboard_transpose(board), tables.left, afterstate);
+            afterstate = bitboard_transpose(afterstate);
+            break;
+        case Down:
+            reward = move_rows(bitboard_transpose(board), tables.right, afterstate);
+            afterstate = bitboard_transpose(afterstate);
+            break;
+        case Left:
+            reward = move_rows(board, tables.left, afterstate);
+            break;
+        case Right:
+            reward = move_rows(board, tables.right, afterstate);
+            break;
+        default:
+            afterstate = board;
+            break;
+    }
+    return reward;
+}
+
+int bitboard_afterstates(const BitBoard board, BitBoard* afterstates, int* rewards)
+{
+    int legal = 0;
+    for (int action = 0; action < 4; action++) {
+        rewards[action] = bitboard_move(board, action, afterstates[action]);
+        if (afterstates[action] != board)
+            legal |= 1 << action;
+    }
+    return legal;
+}
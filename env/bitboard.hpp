@@ -0,0 +1,73 @@
+#ifndef BITBOARD_HPP
+#define BITBOARD_HPP
+
+#include "2048env.hpp"
+#include <cstdint>
+
+/*
+ * Packed 4x4 board: 16 cells of 4-bit tile exponents, cell (y, x) at bits
+ * 4 * (y * 4 + x). Moves are applied through 65536-entry row tables, so
+ * afterstates can be generated without touching Env2048 or the heap.
+ * Only exponents up to BITBOARD_MAX_EXPONENT are accepted, which keeps the
+ * result of every merge inside a nibble; larger boards stay on Env2048.
+ */
+
+typedef uint64_t BitBoard;
+
+#define BITBOARD_SIZE 4
+#define BITBOARD_CELLS 16
+#define BITBOARD_MAX_EXPONENT 14
+
+bool to_bitboard(const Board& board, BitBoard& bitboard);
+Board from_bitboard(const BitBoard bitboard);
+
+// Returns the merge reward and writes the afterstate (equal to board if the move is illegal)
+int bitboard_move(const BitBoard board, const int action, BitBoard& afterstate);
+// Afterstates and rewards of all four actions, returns a bit mask of the legal ones
+int bitboard_afterstates(const BitBoard board, BitBoard* afterstates, int* rewards);
+
+inline int bitboard_exponent(const BitBoard board, const int cell)
+{
+    return static_cast<int>((board >> (4 * cell)) & 0xF);
+}
+
+inline void bitboard_exponents(const BitBoard board, int* exponents)
+{
+    for (int cell = 0; cell < BITBOARD_CELLS; cell++)
+        exponents[cell] = bitboard_exponent(board, cell);
+}
+
+inline BitBoard bitboard_transpose(const BitBoard board)
+{
+    const BitBoard a = (board & 0xF0F00F0FF0F00F0FULL) | ((board & 0x0000F0F00000F0F0ULL) << 12)
+                     | ((board & 0x0F0F00000F0F0000ULL) >> 12);
+    return (a & 0xFF00FF0000FF00FFULL) | ((a & 0x00FF00FF00000000ULL) >> 24) | ((a & 0x00000000FF00FF00ULL) << 24);
+}
+
+// Reverses the order of the rows (y -> 3 - y)
+inline BitBoard bitboard_flip_rows(const BitBoard board)
+{
+    return (board >> 48) | ((board >> 16) & 0x00000000FFFF0000ULL)
+         | ((board << 16) & 0x0000FFFF00000000ULL) | (board << 48);
+}
+
+// Reverses the cells inside every row (x -> 3 - x)
+inline BitBoard bitboard_flip_columns(const BitBoard board)
+{
+    return ((board & 0x000F000F000F000FULL) << 12) | ((board & 0x00F000F000F000F0ULL) << 4)
+         | ((board & 0x0F000F000F000F00ULL) >> 4) | ((board & 0xF000F000F000F000ULL) >> 12);
+}
+
+// Smallest of the 8 rotations and reflections, the same key for all boards of a symmetry class
+inline BitBoard bitboard_canonical(const BitBoard board)
+{
+    BitBoard best = board, b = board;
+    for (int i = 0; i < 8; i++) {
+        b = (i & 1) ? bitboard_flip_rows(b) : bitboard_transpose(b);
+        if (b < best)
+            best = b;
+    }
+    return best;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SEARCH_DEADLINE_HPP
+#define SEARCH_DEADLINE_HPP
+
+#include <atomic>
+#include <chrono>
+
+/*
+ * Per-move time budget polled by the search threads. Once the clock passes
+ * the deadline the expired flag is latched, so every thread sees the same
+ * answer from then on and a search can tell whether any of its values were
+ * cut short. A default-constructed or cleared deadline never expires.
+ */
+class SearchDeadline
+{
+    private:
+        std::chrono::steady_clock::time_point deadline;
+        std::atomic<bool> expired;
+        bool enabled;
+
+    public:
+        SearchDeadline() : expired(false), enabled(false) {}
+
+        void start(const double budget_ms)
+        {
+            deadline = std::chrono::steady_clock::now()
+                     + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(budget_ms));
+            expired.store(false);
+            enabled = true;
+        }
+
+        void clear()
+        {
+            expired.store(false);
+            enabled = false;
+        }
+
+        // Reads the clock, latches and returns true once the budget is spent
+        bool poll()
+        {
+            if (expired.load(std::memory_order_relaxed))
+                return true;
+            if (!enabled || std::chrono::steady_clock::now() < deadline)
+                return false;
+            expired.store(true, std::memory_order_relaxed);
+            return true;
+        }
+
+        // True if a poll has already seen the deadline pass, without reading the clock
+        bool is_expired() const { return expired.load(std::memory_order_relaxed); }
+};
+
+#endif
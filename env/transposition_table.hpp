@@ -0,0 +1,135 @@
+#ifndef TRANSPOSITION_TABLE_HPP
+#define TRANSPOSITION_TABLE_HPP
+
+#include "bitboard.hpp"
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+
+#define DEFAULT_TT_LOG2_ENTRIES 20
+
+/*
+ * Fixed-size table of searched values shared by all search threads without
+ * locks. A slot is two 64-bit atomics: data (float value and remaining depth)
+ * and check = hash ^ data. A reader accepts a slot only if check ^ data gives
+ * back its hash, so a slot torn by a concurrent writer reads as a miss rather
+ * than as a wrong value. Max and chance nodes of the same board are different
+ * entries; the node type is mixed into the hash. With canonical set, the 8
+ * symmetries of a board share one entry, which is only valid for evaluators
+ * that are symmetric themselves (NTupleTD with its symmetric tuples is).
+ *
+ * A search that cuts unlikely chance nodes computes a node's value more
+ * coarsely the less likely the path it came by, so entries also keep that path
+ * probability, in quarters of a power of two, and serve only queries reached
+ * with at most that probability.
+ *
+ * The table can be kept across searches of the same game: every search calls
+ * new_generation, entries remember the generation that stored them, and a
+ * slot held by an earlier generation is given up to any new entry while one
+ * of the current search is only replaced by an entry at least as deep. Values
+ * stay valid across generations as long as the evaluator does not change.
+ * This is a cheap way to invalidate, not a warm start: a node two plies below
+ * the previous root is two plies less deep than the same node below the new
+ * one, so nearly all of an earlier search's entries fail the depth check.
+ */
+class TranspositionTable
+{
+    private:
+        typedef struct {
+            std::atomic<uint64_t> check;
+            std::atomic<uint64_t> data;
+        } Entry;
+
+        std::unique_ptr<Entry[]> entries;
+        size_t mask;
+        bool canonical;
+        uint64_t generation;    // 16 bits, wraps around only after 65536 searches
+
+        uint64_t hash(const BitBoard board, const bool is_max_node) const
+        {
+            uint64_t x = (canonical ? bitboard_canonical(board) : board) ^ (is_max_node ? 0x9E3779B97F4A7C15ULL : 0);
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+            return x ^ (x >> 31);
+        }
+
+        // Bits 0-31 value, 32-39 remaining depth, 40-55 generation, 56-63 probability level
+        uint64_t pack(const double value, const int depth, const int level) const
+        {
+            const float v = static_cast<float>(value);
+            uint32_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            return static_cast<uint64_t>(bits) | (static_cast<uint64_t>(depth & 0xFF) << 32) | (generation << 40)
+                 | (static_cast<uint64_t>(level) << 56);
+        }
+
+        // -4 log2 probability, so a lower level is a likelier path
+        static int probability_level(const double probability)
+        {
+            if (probability >= 1.0)
+                return 0;
+            const double level = -4.0 * std::log2(probability);
+            return level >= 255 ? 255 : static_cast<int>(level);
+        }
+
+        static int entry_depth(const uint64_t data) { return static_cast<int>((data >> 32) & 0xFF); }
+        static int entry_level(const uint64_t data) { return static_cast<int>(data >> 56); }
+        static uint64_t entry_generation(const uint64_t data) { return (data >> 40) & 0xFFFF; }
+
+    public:
+        TranspositionTable(const int log2_entries = DEFAULT_TT_LOG2_ENTRIES, const bool canonical = true)
+            : entries(new Entry[size_t(1) << log2_entries]), mask((size_t(1) << log2_entries) - 1), canonical(canonical), generation(0)
+        {
+            clear();
+        }
+
+        // Starts a search: entries stored from now on age the earlier ones
+        void new_generation() { generation = (generation + 1) & 0xFFFF; }
+
+        void clear()
+        {
+            for (size_t i = 0; i <= mask; i++) {
+                entries[i].check.store(0, std::memory_order_relaxed);
+                entries[i].data.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        // True if the board was searched to at least depth from a path at least as likely, the value is written to value
+        bool probe(const BitBoard board, const bool is_max_node, const int depth, const double probability, double& value) const
+        {
+            const uint64_t key = hash(board, is_max_node);
+            const Entry& entry = entries[key & mask];
+            const uint64_t data = entry.data.load(std::memory_order_relaxed);
+            if ((entry.check.load(std::memory_order_relaxed) ^ data) != key || entry_depth(data) < depth
+             || entry_level(data) > probability_level(probability))
+                return false;
+            float v;
+            const uint32_t bits = static_cast<uint32_t>(data);
+            std::memcpy(&v, &bits, sizeof(v));
+            value = v;
+            return true;
+        }
+
+        // Keeps the same board searched deeper (or as deep from a likelier path) in any generation,
+        // and another board searched deeper in this one
+        void store(const BitBoard board, const bool is_max_node, const int depth, const double probability, const double value)
+        {
+            const uint64_t key = hash(board, is_max_node);
+            Entry& entry = entries[key & mask];
+            const uint64_t old_data = entry.data.load(std::memory_order_relaxed);
+            const bool same_board = (entry.check.load(std::memory_order_relaxed) ^ old_data) == key;
+            const int level = probability_level(probability);
+            if (same_board && entry_depth(old_data) == depth && entry_level(old_data) < level)
+                return;
+            if (entry_depth(old_data) > depth && (same_board || entry_generation(old_data) == generation))
+                return;
+            const uint64_t data = pack(value, depth, level);
+            entry.data.store(data, std::memory_order_relaxed);
+            entry.check.store(key ^ data, std::memory_order_relaxed);
+        }
+};
+
+#endif
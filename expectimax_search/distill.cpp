@@ -0,0 +1,72 @@
+#include "2048env.hpp"
+#include "n_tuple_TD.hpp"
+#include "expectimax_search.hpp"
+#include <iostream>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+/*
+ * Usage: Distill.exe [games] [depth] [num_sample] [strategy]
+ * Plays games with the expectimax engine on the trained weights (teacher) and
+ * regresses a second table (student) on its root action values: the afterstate
+ * of every legal move is trained towards the searched value of that move minus
+ * its merge reward. The student starts from the teacher's weights and is saved
+ * to 2048_distilled_weights.pkl for the greedy player.
+ */
+int main(int argc, char** argv)
+{
+    const int games = (argc > 1) ? std::atoi(argv[1]) : 100;
+    const int depth = (argc > 2) ? std::atoi(argv[2]) : 3;
+    const int num_sample = (argc > 3) ? std::atoi(argv[3]) : DEFAULT_NUM_SAMPLE;
+    SearchStrategy strategy = TwoLevelSplit;
+    if(argc > 4 && !parse_search_strategy(argv[4], strategy)){
+        std::cerr << "Unknown strategy " << argv[4] << "\n";
+        return 1;
+    }
+    const int save_interval = 10;
+    std::vector<Pattern> patterns = default_patterns();
+
+    NTupleTD teacher(patterns);
+    teacher.attach_weights("2048_weights.bin", "2048_weights.pkl");
+    NTupleTD student(patterns, 4, 4, 0, 0.01, 1.0);
+    student.copy_weights(teacher);
+    ExpectimaxEngine engine(teacher, strategy, std::thread::hardware_concurrency());
+    engine.set_chance_expansion(num_sample);
+
+    Env2048 env;    // Seeds rand() from the clock, construct it once
+    for(int game = 1; game <= games; game++) {
+        env.reset();
+        double squared_error = 0;
+        int n_samples = 0;
+        while(!env.is_game_over()) {
+            std::vector<double> action_values = engine.search_values(env.get_board(), depth);
+            if(action_values.empty()) break;
+
+            // Afterstates come from BitBoard, boards beyond its tile range are played but not distilled
+            BitBoard board, afterstates[4];
+            int rewards[4];
+            if(to_bitboard(env.get_board(), board)) {
+                const int legal = bitboard_afterstates(board, afterstates, rewards);
+                for(int action = 0; action < 4; action++) {
+                    if(!((legal >> action) & 1)) continue;
+                    const Board afterstate = from_bitboard(afterstates[action]);
+                    const double target = action_values[action] - rewards[action];
+                    const double error = target - student.cal_value(afterstate);
+                    squared_error += error * error;
+                    n_samples++;
+                    student.regress(afterstate, target);
+                }
+            }
+            env.step(std::distance(action_values.begin(), std::max_element(action_values.begin(), action_values.end())));
+        }
+        std::cout << "Game " << game << ": score " << env.get_score()
+                  << ", RMSE before update " << std::sqrt(squared_error / std::max(n_samples, 1)) << "\n";
+        if(game % save_interval == 0 || game == games)
+            student.save_weights("2048_distilled_weights.pkl");
+    }
+    return 0;
+}
@@ -0,0 +1,586 @@
+#include "2048env.hpp"
+#include "n_tuple_TD.hpp"
+#include "expectimax_search.hpp"
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+static const char *strategy_names[] = {"sequential", "root", "two-level", "task", "bfs"};
+
+bool parse_search_strategy(const std::string &name, SearchStrategy &strategy){
+    for(int i = 0; i < 5; i++){
+        if(name == strategy_names[i]){
+            strategy = static_cast<SearchStrategy>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *search_strategy_name(const SearchStrategy strategy){
+    return strategy_names[strategy];
+}
+
+ExpectimaxEngine::ExpectimaxEngine(const NTupleTD &agent, SearchStrategy strategy, int n_threads):
+    agent(agent), strategy(strategy), thread_pool(strategy == Sequential ? 0 : std::max(n_threads - 1, 0)),
+    num_sample(EXACT_CHANCE), min_probability(DEFAULT_MIN_PROBABILITY),
+    min_task_leaves(strategy == TaskParallel ? -1 : std::numeric_limits<double>::infinity()), use_table(true),
+    use_pruning(false), value_upper(std::numeric_limits<double>::infinity()) {}
+
+// Values searched with another expansion are not comparable, so the table starts over
+void ExpectimaxEngine::set_chance_expansion(int num_sample, double min_probability){
+    this->num_sample = num_sample;
+    this->min_probability = min_probability;
+    transposition_table.clear();
+}
+
+// The value bound scans every weight, so it is taken once here rather than per search
+void ExpectimaxEngine::set_pruning(bool enabled){
+    use_pruning = enabled;
+    if(enabled){
+        double value_lower;
+        agent.value_bounds(value_lower, value_upper);
+    }
+}
+
+double ExpectimaxEngine::heuristic(const Board &state) const {
+    return agent.cal_value(state);
+}
+
+// Heuristic of sibling leaves in one NTupleTD::cal_values pipeline, one by one if a board is beyond BitBoard
+void ExpectimaxEngine::evaluate_leaves(const std::vector<Board> &states, double *values) const {
+    std::vector<BitBoard> boards(states.size());
+    for(size_t i = 0; i < states.size(); i++){
+        if(!to_bitboard(states[i], boards[i])){
+            for(size_t j = 0; j < states.size(); j++){
+                values[j] = heuristic(states[j]);
+            }
+            return;
+        }
+    }
+    agent.cal_values(boards.data(), boards.size(), values);
+}
+
+/*
+ * Times a leaf evaluation and a spawn/wait round trip through the pool. A
+ * subtree becomes a task only if it is expected to cost SPLIT_OVERHEAD_RATIO
+ * times the task overhead, so scheduling stays a few percent of the work
+ * while the subtrees above the cutoff still outnumber the workers.
+ */
+double ExpectimaxEngine::calibrate_split_cutoff(const Board &state){
+    if(thread_pool.size() == 0){
+        return min_task_leaves = std::numeric_limits<double>::infinity();
+    }
+    const int n_evals = 2000, n_tasks = 2000;
+    double sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < n_evals; i++){
+        sink += heuristic(state);
+    }
+    const double eval_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n_evals;
+
+    // The first round wakes the workers up, only the second one is timed
+    std::vector<double> results(n_tasks);
+    double task_ns = 0;
+    for(int round = 0; round < 2; round++){
+        TaskGroup group;
+        start = std::chrono::steady_clock::now();
+        for(int i = 0; i < n_tasks; i++){
+            double &result = results[i];
+            thread_pool.spawn(group, [&result, sink]{ result = sink; });
+        }
+        thread_pool.wait(group);
+        task_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n_tasks;
+    }
+
+    min_task_leaves = std::max(1.0, SPLIT_OVERHEAD_RATIO * task_ns / std::max(eval_ns, 1.0));
+    return min_task_leaves;
+}
+
+// Rough leaf count below a node: about 3 legal moves per max node and one child per spawn (or sample) per chance node
+static double estimated_leaves(const Board &state, int depth, int num_sample, bool is_maxNode){
+    int n_empty = 0;
+    for(const auto &row : state){
+        n_empty += std::count(row.begin(), row.end(), 0);
+    }
+    const double chance_branching = (num_sample == EXACT_CHANCE) ? 2.0 * std::max(n_empty, 1) : num_sample;
+    const int max_plies = is_maxNode ? (depth + 1) / 2 : depth / 2;
+    return std::pow(3.0, max_plies) * std::pow(chance_branching, depth - max_plies);
+}
+
+// Whether the children of a node (ply moves below the root) become pool tasks
+bool ExpectimaxEngine::should_split(const Board &state, int depth, int ply, bool is_maxNode) const {
+    switch(strategy){
+        case RootSplit:
+            return ply == 0;
+        case TwoLevelSplit:
+            return ply <= 1;
+        case TaskParallel:
+            return estimated_leaves(state, depth, num_sample, is_maxNode) >= min_task_leaves;
+        default:
+            return false;
+    }
+}
+
+// Runs task as a pool task when the subtree is worth one, inline otherwise
+template <class F>
+static void fork_child(ThreadPool &thread_pool, TaskGroup &group, bool split, F &&task){
+    if(split){
+        thread_pool.spawn(group, std::forward<F>(task));
+    }
+    else{
+        task();
+    }
+}
+
+/*
+ * Upper bound of the rewards a chance node's subtree can still collect: a
+ * move scores at most the tile sum of its board, and every spawn before it
+ * adds at most 4 to that sum.
+ */
+static double reward_bound(const Board &state, int depth){
+    double tile_sum = 0;
+    for(const auto &row : state){
+        for(int tile : row){
+            tile_sum += tile;
+        }
+    }
+    double bound = 0;
+    for(int move = 1; move <= depth / 2; move++){
+        bound += tile_sum + 4.0 * move;
+    }
+    return bound;
+}
+
+double ExpectimaxEngine::search_node(const Board &state, int depth, int ply, bool is_maxNode, double probability, double alpha){
+    if(depth <= 0){
+        return heuristic(state);
+    }
+
+    Env2048 env;
+    env.set_board(state);
+    if(env.is_game_over()){
+        return heuristic(state);
+    }
+
+    if(search_deadline.poll()){
+        return 0;
+    }
+
+    // Boards beyond the BitBoard tile range are searched without the table
+    BitBoard key;
+    const bool cached = use_table && to_bitboard(state, key);
+    double value = 0;
+    if(cached && transposition_table.probe(key, is_maxNode, depth, probability, value)){
+        return value;
+    }
+
+    // Children of split nodes are tasks, the thread waits for them by running tasks itself
+    TaskGroup group;
+    const bool split = should_split(state, depth, ply, is_maxNode);
+    // Children that can only be leaves are evaluated together: the last ply, and the chance
+    // children of a max node already below the probability cutoff
+    const bool leaf_children = depth == 1 || (is_maxNode && num_sample == EXACT_CHANCE && probability < min_probability);
+    if(is_maxNode){
+        // Max Node
+        value = -std::numeric_limits<double>::infinity();
+        std::vector<int> actions = env.get_legal_actions();
+        std::vector<double> rewards(actions.size());
+        std::vector<Board> next_states(actions.size());
+        std::vector<double> results(actions.size());
+        for(int i = 0; i < actions.size(); i++){
+            env.set_board(state);
+            env.set_score(0);
+            auto [next_state, reward, done] = env.step(actions[i]);
+            rewards[i] = static_cast<double>(reward);
+            next_states[i] = next_state;
+        }
+        if(leaf_children){
+            evaluate_leaves(next_states, results.data());
+        }
+        // Inline children raise alpha for the next ones, tasks all start from the node's alpha
+        double best = alpha;
+        for(int i = 0; !leaf_children && i < actions.size(); i++){
+            const Board &next_state = next_states[i];
+            const double child_alpha = best - rewards[i];
+            double &result = results[i];
+            fork_child(thread_pool, group, split, [=, &result] {
+                result = search_node(next_state, depth - 1, ply + 1, false, probability, child_alpha);
+            });
+            if(!split){
+                best = std::max(best, rewards[i] + result);
+            }
+        }
+        thread_pool.wait(group);
+
+        for(int i = 0; i < results.size(); i++){
+            value = std::max(value, rewards[i] + results[i]);
+        }
+    }
+    else{
+        // Chance Node
+        std::vector<std::pair<Board, double>> outcomes;
+        if(num_sample == EXACT_CHANCE){
+            // Every spawn weighted by its probability, paths too unlikely to matter are cut
+            if(probability < min_probability){
+                return heuristic(state);
+            }
+            outcomes = env.get_spawn_outcomes();
+        }
+        for(int i = 0; i < num_sample; i++){
+            env.set_board(state);
+            env.set_score(0);
+            env.add_random_tile();
+            outcomes.emplace_back(env.get_board(), 1.0 / num_sample);
+        }
+        std::vector<double> results(outcomes.size());
+        if(leaf_children){
+            std::vector<Board> next_states(outcomes.size());
+            for(int i = 0; i < outcomes.size(); i++){
+                next_states[i] = outcomes[i].first;
+            }
+            evaluate_leaves(next_states, results.data());
+        }
+        // Star1: children not searched yet are worth at most child_upper, so once even that
+        // cannot lift the node above alpha the rest are cut and the bound is returned
+        const bool prune = use_pruning && alpha > -std::numeric_limits<double>::infinity();
+        const double child_upper = prune ? value_upper + reward_bound(state, depth) : 0;
+        double searched = 0, unsearched = 1.0;
+        bool cut = false;
+        for(int i = 0; !leaf_children && !cut && i < outcomes.size(); i++){
+            const Board &next_state = outcomes[i].first;
+            const double weight = outcomes[i].second;
+            double next_probability = num_sample == EXACT_CHANCE ? probability * weight : probability;
+            unsearched -= weight;
+            // Least value of this child that can still lift the node above alpha
+            const double others = split ? (1.0 - weight) * child_upper : searched + unsearched * child_upper;
+            const double child_alpha = prune ? (alpha - others) / weight : -std::numeric_limits<double>::infinity();
+            double &result = results[i];
+            fork_child(thread_pool, group, split, [=, &result] {
+                result = search_node(next_state, depth - 1, ply + 1, true, next_probability, child_alpha);
+            });
+            if(!split){
+                searched += weight * result;
+                cut = prune && searched + unsearched * child_upper <= alpha;
+            }
+        }
+        thread_pool.wait(group);
+
+        if(cut){
+            value = searched + unsearched * child_upper;
+        }
+        for(int i = 0; !cut && i < results.size(); i++){
+            value += outcomes[i].second * results[i];
+        }
+    }
+    // Values of a search cut short by the deadline are partial, values at most alpha are only
+    // upper bounds, neither is stored
+    if(cached && !search_deadline.is_expired() && (!use_pruning || value > alpha)){
+        transposition_table.store(key, is_maxNode, depth, probability, value);
+    }
+    return value;
+}
+
+// A max node has one child per legal move
+int MaxNode::count_children(){
+    BitBoard afterstates[4];
+    int rewards[4];
+    const int legal = (depth > 0) ? bitboard_afterstates(state, afterstates, rewards) : 0;
+    is_leaf = legal == 0;
+    return n_children = __builtin_popcount(legal);
+}
+
+void MaxNode::expand(ChanceNode *children) const {
+    BitBoard afterstates[4];
+    int rewards[4];
+    const int legal = bitboard_afterstates(state, afterstates, rewards);
+    int n = 0;
+    for(int action = 0; action < 4; action++){
+        if((legal >> action) & 1){
+            children[n++] = ChanceNode(afterstates[action], depth - 1, probability, rewards[action]);
+        }
+    }
+}
+
+void MaxNode::pass_value_up(const ChanceNode *children){
+    value = -std::numeric_limits<double>::infinity();
+    for(int i = 0; i < n_children; i++){
+        value = std::max(value, children[i].reward + children[i].value);
+    }
+}
+
+// A chance node has a child per empty cell and tile (exact) or num_sample sampled spawns
+int ChanceNode::count_children(int num_sample, double min_probability){
+    int n_empty = 0;
+    for(int cell = 0; cell < BITBOARD_CELLS; cell++){
+        n_empty += bitboard_exponent(state, cell) == 0;
+    }
+    is_leaf = depth <= 0 || n_empty == 0 || (num_sample == EXACT_CHANCE && probability < min_probability);
+    return n_children = is_leaf ? 0 : (num_sample == EXACT_CHANCE ? 2 * n_empty : num_sample);
+}
+
+void ChanceNode::expand(MaxNode *children, int num_sample) const {
+    int empty[BITBOARD_CELLS], n_empty = 0;
+    for(int cell = 0; cell < BITBOARD_CELLS; cell++){
+        if(bitboard_exponent(state, cell) == 0){
+            empty[n_empty++] = cell;
+        }
+    }
+    if(num_sample == EXACT_CHANCE){
+        for(int i = 0; i < n_empty; i++){
+            const double p2 = 0.9 / n_empty, p4 = 0.1 / n_empty;
+            children[2 * i] = MaxNode(state | (BitBoard(1) << (4 * empty[i])), depth - 1, probability * p2, p2);
+            children[2 * i + 1] = MaxNode(state | (BitBoard(2) << (4 * empty[i])), depth - 1, probability * p4, p4);
+        }
+        return;
+    }
+    // Same draw as Env2048::add_random_tile
+    for(int i = 0; i < num_sample; i++){
+        const int cell = empty[rand() % n_empty];
+        const BitBoard exponent = (rand() % 10 == 0) ? 2 : 1;
+        children[i] = MaxNode(state | (exponent << (4 * cell)), depth - 1, probability, 1.0 / num_sample);
+    }
+}
+
+void ChanceNode::pass_value_up(const MaxNode *children){
+    value = 0;
+    for(int i = 0; i < n_children; i++){
+        value += children[i].weight * children[i].value;
+    }
+}
+
+// Runs body(begin, end) over [0, n) in chunks, as pool tasks when the pool has workers
+template <class F>
+static void parallel_for(ThreadPool &thread_pool, size_t n, F &&body){
+    const size_t chunk = std::max<size_t>(LEVEL_CHUNK_NODES, (n + 4 * thread_pool.size()) / (4 * thread_pool.size() + 1));
+    TaskGroup group;
+    for(size_t begin = 0; begin < n; begin += chunk){
+        const size_t end = std::min(begin + chunk, n);
+        if(thread_pool.size() == 0){
+            body(begin, end);
+        }
+        else{
+            thread_pool.spawn(group, [&body, begin, end]{ body(begin, end); });
+        }
+    }
+    thread_pool.wait(group);
+}
+
+// Counts the children of every node of a level, then places them in the next level by prefix sum
+template <class Parent, class Child, class Count, class Expand>
+static bool expand_level(ThreadPool &thread_pool, std::vector<Parent> &level, std::vector<Child> &next_level,
+                         SearchDeadline &search_deadline, bool poll, Count &&count, Expand &&expand){
+    parallel_for(thread_pool, level.size(), [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            count(level[i]);
+        }
+    });
+    size_t n_next = 0;
+    for(auto &node : level){
+        node.first_child = n_next;
+        n_next += node.n_children;
+    }
+    next_level.resize(n_next);
+    parallel_for(thread_pool, level.size(), [&](size_t begin, size_t end){
+        if(poll && search_deadline.poll()){
+            return;
+        }
+        for(size_t i = begin; i < end; i++){
+            if(!level[i].is_leaf){
+                expand(level[i], &next_level[level[i].first_child]);
+            }
+        }
+    });
+    return !search_deadline.is_expired();
+}
+
+// Evaluates the leaves of a level in batches and reduces the other nodes from their children
+template <class Parent, class Child>
+static void reduce_level(ThreadPool &thread_pool, const NTupleTD &agent, std::vector<Parent> &level, const std::vector<Child> *next_level){
+    parallel_for(thread_pool, level.size(), [&](size_t begin, size_t end){
+        BitBoard boards[LEVEL_EVAL_BATCH];
+        double values[LEVEL_EVAL_BATCH];
+        size_t leaves[LEVEL_EVAL_BATCH];
+        int n_leaves = 0;
+        for(size_t i = begin; i < end; i++){
+            if(level[i].is_leaf){
+                leaves[n_leaves] = i;
+                boards[n_leaves++] = level[i].state;
+            }
+            else{
+                level[i].pass_value_up(&(*next_level)[level[i].first_child]);
+            }
+            if(n_leaves == LEVEL_EVAL_BATCH || (i + 1 == end && n_leaves > 0)){
+                agent.cal_values(boards, n_leaves, values);
+                for(int b = 0; b < n_leaves; b++){
+                    level[leaves[b]].value = values[b];
+                }
+                n_leaves = 0;
+            }
+        }
+    });
+}
+
+/*
+ * Breadth-first search of the root actions: the tree is expanded level by
+ * level, then every level from the deepest up evaluates its leaves and takes
+ * the max or expectation over its children. Empty if the root is not a
+ * BitBoard, has no move or the deadline passed (depth 1 never polls it).
+ */
+std::vector<double> ExpectimaxEngine::search_levels(const Board &root, int depth){
+    BitBoard root_board;
+    if(!to_bitboard(root, root_board)){
+        return {};
+    }
+    const bool poll = depth > 1;
+    max_levels.resize((depth + 2) / 2);
+    chance_levels.resize((depth + 1) / 2);
+    max_levels[0].assign(1, MaxNode(root_board, depth));
+    if(max_levels[0][0].count_children() == 0){
+        return {};
+    }
+    for(int level = 0; level < depth; level++){
+        bool completed;
+        if(level % 2 == 0){
+            completed = expand_level(thread_pool, max_levels[level / 2], chance_levels[level / 2], search_deadline, poll,
+                                     [](MaxNode &node){ node.count_children(); },
+                                     [](const MaxNode &node, ChanceNode *children){ node.expand(children); });
+        }
+        else{
+            completed = expand_level(thread_pool, chance_levels[level / 2], max_levels[level / 2 + 1], search_deadline, poll,
+                                     [this](ChanceNode &node){ node.count_children(num_sample, min_probability); },
+                                     [this](const ChanceNode &node, MaxNode *children){ node.expand(children, num_sample); });
+        }
+        if(!completed){
+            return {};
+        }
+    }
+    for(int level = depth; level >= 1; level--){
+        if(level % 2 == 0){
+            reduce_level(thread_pool, agent, max_levels[level / 2], level < depth ? &chance_levels[level / 2] : nullptr);
+        }
+        else{
+            reduce_level(thread_pool, agent, chance_levels[level / 2], level < depth ? &max_levels[level / 2 + 1] : nullptr);
+        }
+    }
+
+    const MaxNode &root_node = max_levels[0][0];
+    std::vector<double> action_values(4, -std::numeric_limits<double>::infinity());
+    BitBoard afterstates[4];
+    int rewards[4];
+    const int legal = bitboard_afterstates(root_board, afterstates, rewards);
+    for(int action = 0, i = 0; action < 4; action++){
+        if((legal >> action) & 1){
+            const ChanceNode &child = chance_levels[0][root_node.first_child + i++];
+            action_values[action] = child.reward + child.value;
+        }
+    }
+    return action_values;
+}
+
+// Values of the root actions, searched to depth below the root
+std::vector<double> ExpectimaxEngine::search_root(const Board &root, int depth){
+    if(strategy == LevelSynchronous){
+        // Boards beyond the BitBoard tile range fall back to the depth-first search below
+        std::vector<double> action_values = search_levels(root, depth);
+        if(!action_values.empty() || search_deadline.is_expired()){
+            return action_values;
+        }
+    }
+
+    Env2048 env;
+    env.set_board(root);
+    std::vector<int> actions = env.get_legal_actions();
+    if(actions.size() == 0){
+        return {};
+    }
+
+    TaskGroup group;
+    const bool split = should_split(root, depth, 0, true);
+    std::vector<double> action_values(env.get_n_actions(), -std::numeric_limits<double>::infinity());
+    std::vector<double> results(actions.size());
+    std::vector<Board> next_states(actions.size());
+    for (int i = 0; i < actions.size(); i++) {
+        env.set_board(root);
+        env.set_score(0);
+        auto [next_state, reward, done] = env.step(actions[i]);
+        action_values[actions[i]] = static_cast<double>(reward);
+        next_states[i] = next_state;
+    }
+    if (depth == 1) {
+        evaluate_leaves(next_states, results.data());
+    }
+    double best = -std::numeric_limits<double>::infinity();
+    for (int i = 0; depth > 1 && i < actions.size(); i++) {
+        const Board &next_state = next_states[i];
+        const double child_alpha = best - action_values[actions[i]];
+        double &result = results[i];
+        fork_child(thread_pool, group, split, [=, &result] {
+            result = search_node(next_state, depth - 1, 1, false, 1.0, child_alpha);
+        });
+        if (!split) {
+            best = std::max(best, action_values[actions[i]] + result);
+        }
+    }
+    thread_pool.wait(group);
+
+    for (int i = 0; i < actions.size(); i++) {
+        action_values[actions[i]] += results[i];
+    }
+    return action_values;
+}
+
+std::vector<double> ExpectimaxEngine::search_values(const Board &root, int depth){
+    if(depth <= 0 || num_sample < 0){
+        return {};
+    }
+    if(min_task_leaves < 0){
+        calibrate_split_cutoff(root);
+    }
+    transposition_table.new_generation();
+    search_deadline.clear();
+    return search_root(root, depth);
+}
+
+int ExpectimaxEngine::search(const Board &root, int depth){
+    std::vector<double> action_values = search_values(root, depth);
+    if(action_values.empty()){
+        return -1;
+    }
+    return std::distance(action_values.begin(), std::max_element(action_values.begin(), action_values.end()));
+}
+
+int ExpectimaxEngine::search_timed(const Board &root, double time_budget_ms, int max_depth){
+    if(max_depth <= 0 || num_sample < 0){
+        return -1;
+    }
+    if(min_task_leaves < 0){
+        calibrate_split_cutoff(root);
+    }
+    search_deadline.start(time_budget_ms);
+    transposition_table.new_generation();
+
+    // Depth 1 only evaluates afterstates and never polls the deadline, so there is always a move.
+    // Odd depths keep the leaves on afterstates, which is what the value function was trained on.
+    // An iteration gets next to nothing from the shallower ones: what they stored at the same ply is
+    // two plies too shallow to be probed, and only a board reached both by a 4 and by two 2 spawns
+    // is found at another ply. Depths 1 .. d - 2 cost about 5% of d.
+    int best_action = -1;
+    for(int depth = 1; depth <= max_depth; depth += 2){
+        std::vector<double> action_values = search_root(root, depth);
+        if(search_deadline.is_expired()){
+            break;
+        }
+        if(action_values.empty()){
+            return -1;
+        }
+        best_action = std::distance(action_values.begin(), std::max_element(action_values.begin(), action_values.end()));
+    }
+    search_deadline.clear();
+    return best_action;
+}
@@ -0,0 +1,132 @@
+#ifndef EXPECTIMAX_SEARCH_HPP
+#define EXPECTIMAX_SEARCH_HPP
+
+#include "2048env.hpp"
+#include "n_tuple_TD.hpp"
+#include "thread_pool.hpp"
+#include "transposition_table.hpp"
+#include "search_deadline.hpp"
+
+#include <vector>
+#include <string>
+#include <limits>
+
+#define DEFAULT_NUM_SAMPLE 10
+#define EXACT_CHANCE 0                  // num_sample that expands every spawn with its probability instead of sampling
+#define DEFAULT_MIN_PROBABILITY 1e-4    // Exact chance nodes less likely than this are evaluated by the heuristic
+#define DEFAULT_MAX_DEPTH 15            // Deepest iteration of search_timed
+#define SPLIT_OVERHEAD_RATIO 50         // Least work, in task overheads, worth a parallel task
+#define LEVEL_CHUNK_NODES 256           // Least nodes per task of a level-synchronous loop
+#define LEVEL_EVAL_BATCH 16             // Leaves evaluated together by NTupleTD::cal_values
+
+/*
+ * Nodes of the level-synchronous (LevelSynchronous) search. Every level of
+ * the tree is one array of a single node type, max and chance levels
+ * alternating, and a node refers to its children as a range of the next
+ * level's array. A level is therefore expanded, evaluated and reduced by flat
+ * parallel loops, and the arrays are kept between searches as an arena.
+ */
+class Node
+{
+    public:
+        BitBoard state;
+        double value;
+        bool is_leaf;       // If depth == 0, game over or below the probability cutoff
+        int depth;          // Remaining depth
+        double probability; // Probability of the path from the root
+        size_t first_child; // Children are the next level's nodes [first_child, first_child + n_children)
+        int n_children;
+        Node(const BitBoard state = 0, int depth = 0, double probability = 1.0):
+            state(state), value(0.0), is_leaf(depth <= 0), depth(depth), probability(probability), first_child(0), n_children(0) {}
+};
+
+class ChanceNode;
+
+class MaxNode: public Node
+{
+    public:
+        double weight;      // Probability of the spawn that led here, given its parent
+        MaxNode(const BitBoard state = 0, int depth = 0, double probability = 1.0, double weight = 1.0):
+            Node(state, depth, probability), weight(weight) {}
+        int count_children();
+        void expand(ChanceNode *children) const;
+        void pass_value_up(const ChanceNode *children);
+};
+
+class ChanceNode: public Node
+{
+    public:
+        double reward;      // Reward obtained to reach this node
+        ChanceNode(const BitBoard state = 0, int depth = 0, double probability = 1.0, double reward = 0.0):
+            Node(state, depth, probability), reward(reward) {}
+        int count_children(int num_sample, double min_probability);
+        void expand(MaxNode *children, int num_sample) const;
+        void pass_value_up(const MaxNode *children);
+};
+
+/*
+ * Where the search tree is cut into parallel tasks. The first three are the
+ * former per-directory engines (sequential, first layer and second layer
+ * expansion); TaskParallel splits at any depth while the subtree is large
+ * enough to pay for a task, which is what the fully expanded engine became.
+ * LevelSynchronous searches breadth first over whole levels (see Node).
+ */
+enum SearchStrategy {Sequential, RootSplit, TwoLevelSplit, TaskParallel, LevelSynchronous};
+
+bool parse_search_strategy(const std::string &name, SearchStrategy &strategy);
+const char *search_strategy_name(const SearchStrategy strategy);
+
+/*
+ * One expectimax search core for every strategy. The engine owns the thread
+ * pool (n_threads searching threads: the caller plus n_threads - 1 workers),
+ * the transposition table and the deadline, and evaluates leaves with the
+ * agent's value function. An engine is meant to last a whole game: a search
+ * starts a new table generation instead of clearing the 16 MB table, which is
+ * the whole saving (see TranspositionTable::new_generation). What earlier
+ * moves stored is almost never probed again.
+ */
+class ExpectimaxEngine
+{
+    private:
+        const NTupleTD &agent;
+        SearchStrategy strategy;
+        ThreadPool thread_pool;
+        TranspositionTable transposition_table;
+        SearchDeadline search_deadline;
+        int num_sample;
+        double min_probability;
+        double min_task_leaves;     // TaskParallel subtrees estimated below this many leaves run inline
+        bool use_table;
+        bool use_pruning;
+        double value_upper;         // Largest value the agent's value function can give (NTupleTD::value_bounds)
+        std::vector<std::vector<MaxNode>> max_levels;       // Levels 0, 2, 4, ... of the level-synchronous tree
+        std::vector<std::vector<ChanceNode>> chance_levels; // Levels 1, 3, 5, ...
+
+        double heuristic(const Board &state) const;
+        void evaluate_leaves(const std::vector<Board> &states, double *values) const;
+        bool should_split(const Board &state, int depth, int ply, bool is_maxNode) const;
+        double search_node(const Board &state, int depth, int ply, bool is_maxNode, double probability,
+                           double alpha = -std::numeric_limits<double>::infinity());
+        std::vector<double> search_root(const Board &root, int depth);
+        std::vector<double> search_levels(const Board &root, int depth);
+
+    public:
+        ExpectimaxEngine(const NTupleTD &agent, SearchStrategy strategy = Sequential, int n_threads = 1);
+
+        void set_chance_expansion(int num_sample, double min_probability = DEFAULT_MIN_PROBABILITY);
+        // Searching without the table reproduces the timings measured before it existed (plot.py)
+        void set_transposition_table(bool enabled) { use_table = enabled; }
+        // Star1 pruning of chance nodes against the best sibling found so far (depth-first strategies)
+        void set_pruning(bool enabled);
+        double calibrate_split_cutoff(const Board &state);
+
+        // Best action of a fixed-depth search, -1 if no move is possible
+        int search(const Board &root, int depth);
+        // Searched value (reward plus expected value) of every root action, -inf for illegal ones; empty if no move is possible.
+        // With pruning, actions that cannot be the best get an upper bound no larger than the best value instead.
+        std::vector<double> search_values(const Board &root, int depth);
+        // Iterative deepening over depths 1, 3, 5, ... until the budget runs out, returns the best action of the last completed depth
+        int search_timed(const Board &root, double time_budget_ms, int max_depth = DEFAULT_MAX_DEPTH);
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "2048env.hpp"
+#include "n_tuple_TD.hpp"
+#include "expectimax_search.hpp"
+#include "game_record.hpp"
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+/*
+ * Usage: Expectimax.exe [--strategy sequential|root|two-level|task|bfs] [--threads n]
+ *                       [--depth d] [--samples s] [--budget ms] [--table 0|1] [--prune 0|1]
+ *                       [--record path]
+ * Plays one game and reports the average time of the first 100 moves.
+ * --samples 0 (the default) expands every spawn exactly, --budget switches
+ * from fixed depth to iterative deepening within ms per move, --prune 1 cuts
+ * chance nodes that cannot change the move (Star1), --record appends the game
+ * to a record file for offline training (TD_learning_offline.exe).
+ */
+int main(int argc, char** argv)
+{
+    SearchStrategy strategy = TwoLevelSplit;
+    int n_threads = std::thread::hardware_concurrency();
+    int depth = 5;
+    int num_sample = EXACT_CHANCE;
+    double time_budget_ms = 0;
+    bool use_table = true;
+    bool use_pruning = false;
+    std::string record_path;
+    for(int i = 1; i + 1 < argc; i += 2){
+        const std::string flag = argv[i];
+        if(flag == "--strategy" && parse_search_strategy(argv[i + 1], strategy)) continue;
+        else if(flag == "--threads") n_threads = std::atoi(argv[i + 1]);
+        else if(flag == "--depth") depth = std::atoi(argv[i + 1]);
+        else if(flag == "--samples") num_sample = std::atoi(argv[i + 1]);
+        else if(flag == "--budget") time_budget_ms = std::atof(argv[i + 1]);
+        else if(flag == "--table") use_table = std::atoi(argv[i + 1]) != 0;
+        else if(flag == "--prune") use_pruning = std::atoi(argv[i + 1]) != 0;
+        else if(flag == "--record") record_path = argv[i + 1];
+        else {
+            std::cerr << "Unknown option " << flag << " " << argv[i + 1] << "\n";
+            return 1;
+        }
+    }
+    std::vector<Pattern> patterns = default_patterns();
+
+    NTupleTD agent(patterns);
+    Env2048 env;
+    env.reset();
+
+    agent.attach_weights("2048_weights.bin", "2048_weights.pkl");
+    agent.replicate_weights_numa();
+    ExpectimaxEngine engine(agent, strategy, n_threads);
+    engine.set_chance_expansion(num_sample);
+    engine.set_transposition_table(use_table);
+    engine.set_pruning(use_pruning);
+    std::cout << "Strategy: " << search_strategy_name(strategy) << ", threads: " << n_threads << "\n";
+    GameRecorder recorder(record_path);
+    bool recording = !record_path.empty();
+    std::chrono::duration<double, std::milli> duration;
+    double total_duration = 0;
+    int n_step = 0;
+    while(true) {
+        auto start = std::chrono::high_resolution_clock::now();
+        int action = (time_budget_ms > 0) ? engine.search_timed(env.get_board(), time_budget_ms)
+                                          : engine.search(env.get_board(), depth);
+        auto end = std::chrono::high_resolution_clock::now();
+        duration = end - start;
+        if(n_step < 100){
+            total_duration += duration.count();
+        }
+        n_step += 1;
+
+        BitBoard board, afterstate;
+        if(recording && to_bitboard(env.get_board(), board)){
+            const int reward = bitboard_move(board, action, afterstate);
+            recorder.add_move(afterstate, reward);
+        }
+        else if(recording){
+            // Beyond the tiles BitBoard holds, keep the recorded part as a game cut short
+            recorder.truncate_game();
+            recording = false;
+        }
+        env.step(action);
+        env.print_board();
+
+        if(env.is_game_over()) {
+            recorder.end_game();
+            std::cout << "Game Over! The final score is: " << env.get_score() << "\n";
+            break;
+        }
+    }
+    std::cout << "The average time spent for steps is " << total_duration / std::min(n_step, 100) << std::endl;
+}
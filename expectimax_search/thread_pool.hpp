@@ -0,0 +1,157 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+// #pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "weight_storage.hpp"
+
+// Tasks spawned together and waited for together, see ThreadPool::wait
+class TaskGroup {
+    friend class ThreadPool;
+private:
+    std::atomic<int> pending{0};
+};
+
+/*
+ * Work-stealing pool for fork-join search. Every worker owns a deque: it
+ * pushes and pops its own tasks at the back (depth first, cache warm) while
+ * idle workers steal from the front of the others (the oldest, largest
+ * subtrees). Threads outside the pool push to one extra shared deque. wait()
+ * never blocks: the waiting thread runs queued tasks, its own children first,
+ * until its group is done, so tasks can spawn and wait at any depth without
+ * deadlock, and a pool of 0 workers runs everything on the caller.
+ */
+class ThreadPool {
+private:
+    typedef struct {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    } WorkerQueue;
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;   // One per worker, the last one for outside threads
+
+    std::atomic<int> queued{0};
+    std::atomic<int> sleeping{0};
+    std::mutex sleep_mutex;
+    std::condition_variable condition;
+    std::atomic<bool> stop{false};
+
+    inline static thread_local const ThreadPool* owner = nullptr;
+    inline static thread_local size_t worker_index = 0;
+
+    size_t local_queue() const {
+        return (owner == this) ? worker_index : workers.size();
+    }
+
+    bool pop_task(std::function<void()>& task) {
+        const size_t n_queues = queues.size();
+        const size_t local = local_queue();
+        {
+            WorkerQueue& queue = *queues[local];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        for (size_t i = 1; i < n_queues; ++i) {
+            WorkerQueue& victim = *queues[(local + i) % n_queues];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run_worker(size_t i) {
+        owner = this;
+        worker_index = i;
+        std::function<void()> task;
+        while (true) {
+            if (pop_task(task)) {
+                // The pool may start before the weights are replicated per NUMA node
+                if (current_numa_node < 0)
+                    numa_pin_thread(static_cast<int>(i));
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleeping.fetch_add(1);
+            condition.wait(lock, [this] {
+                return stop.load() || queued.load() > 0;
+            });
+            sleeping.fetch_sub(1);
+            if (stop.load() && queued.load() == 0) return;
+        }
+    }
+
+public:
+    ThreadPool(size_t n) {
+        for (size_t i = 0; i <= n; ++i)
+            queues.emplace_back(new WorkerQueue());
+        for (size_t i = 0; i < n; ++i)
+            workers.emplace_back([this, i] { run_worker(i); });
+    }
+
+    size_t size() const { return workers.size(); }
+
+    // 提交任務: f runs on some pool thread (or on a thread waiting in wait) before wait(group) returns
+    template <class F>
+    void spawn(TaskGroup& group, F&& f) {
+        group.pending.fetch_add(1);
+        {
+            WorkerQueue& queue = *queues[local_queue()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.emplace_back([&group, f = std::forward<F>(f)]() mutable {
+                f();
+                group.pending.fetch_sub(1);
+            });
+        }
+        queued.fetch_add(1);
+        // Paired with the sleeping count taken under sleep_mutex, so a worker
+        // going to sleep either sees the task or gets this notification
+        if (sleeping.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            condition.notify_one();
+        }
+    }
+
+    // Runs queued tasks until every task of the group has finished
+    void wait(TaskGroup& group) {
+        std::function<void()> task;
+        while (group.pending.load() > 0) {
+            if (pop_task(task))
+                task();
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            stop.store(true);
+        }
+
+        condition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+};
+
+#endif
@@ -1,84 +0,0 @@
-#ifndef THREAD_POOL_HPP
-#define THREAD_POOL_HPP
-
-// #pragma once
-#include <vector>
-#include <thread>
-#include <queue>
-#include <future>
-#include <mutex>
-#include <condition_variable>
-#include <functional>
-#include <type_traits>
-#include <iostream>
-
-class ThreadPool {
-private:
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
-
-    std::mutex queue_mutex;
-    std::condition_variable condition;
-    bool stop = false;
-public:
-    ThreadPool(size_t n) {
-        for (size_t i = 0; i < n; ++i) {
-            workers.emplace_back([this] {
-                while (true) {
-                    std::function<void()> task;
-
-                    // critical section
-                    {
-                        std::unique_lock<std::mutex> lock(queue_mutex);
-                        condition.wait(lock, [this] {
-                            return stop || !tasks.empty();
-                        });
-
-                        if (stop && tasks.empty()) return;
-
-                        task = std::move(tasks.front());
-                        tasks.pop();
-                    }
-
-                    task();
-                }
-            });
-        }
-    }
-
-    // 提交任務
-    template <class F, class... Args>
-    auto submit(F&& f, Args&&... args)
-        -> std::future<typename std::result_of<F(Args...)>::type> {
-
-        using return_type = typename std::result_of<F(Args...)>::type;
-
-        auto task = std::make_shared<std::packaged_task<return_type()>>(
-            std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-        );
-
-        std::future<return_type> res = task->get_future();
-
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            tasks.emplace([task]() { (*task)(); });
-        }
-
-        condition.notify_one();
-        return res;
-    }
-
-    ~ThreadPool() {
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            stop = true;
-        }
-
-        condition.notify_all();
-        for (auto& worker : workers) {
-            worker.join();
-        }
-    }
-};
-
-#endif
\ No newline at end of file
@@ -622,6 +622,8 @@ DecisionNode *MCTS::expand_workerC(Env2048 &env, ChanceNode *root)
 }
 
 // Only called by worker
+// One cal_value per rollout, after a dependent chain of random moves: there is
+// no second independent board to batch with, see rollout in mcts_sequential_ver
 double MCTS::rollout_worker(Env2048 &env, const DecisionNode *leaf)
 {
     env.set_board(leaf->board);
@@ -794,6 +796,7 @@ ThreadPool::ThreadPool(MCTS &mcts, const unsigned int num_threads)
     this->envs.resize(num_threads);
     for (unsigned int i = 0; i < num_threads; i++) {
         this->pool.emplace_back([this, &mcts, i] {
+            numa_pin_thread(i);
             while (true) {
                 bool assigned = false;
                 std::shared_ptr<Task> task;
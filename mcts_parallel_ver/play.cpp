@@ -7,20 +7,12 @@
 
 int main()
 {
-    std::vector<Pattern> patterns = {
-        {{0, 0}, {0, 1}, {0, 2}, {1, 0}, {1, 1}, {1, 2}},
-        {{0, 1}, {0, 2}, {1, 1}, {1, 2}, {2, 1}, {3, 1}},
-        {{0, 0}, {1, 0}, {2, 0}, {3, 0}, {0, 1}, {1, 1}},
-        {{0, 0}, {0, 1}, {1, 1}, {1, 2}, {1, 3}, {2, 2}},
-        {{0, 0}, {0, 1}, {0, 2}, {1, 1}, {2, 1}, {2, 2}},
-        {{0, 0}, {0, 1}, {1, 1}, {2, 1}, {3, 1}, {3, 2}},
-        {{0, 0}, {0, 1}, {1, 1}, {2, 0}, {2, 1}, {3, 1}},
-        {{0, 0}, {0, 1}, {0, 2}, {1, 0}, {1, 2}, {2, 2}}
-    };
+    std::vector<Pattern> patterns = default_patterns();
     std::cout << std::setprecision(4);
 
     NTupleTD agent(patterns);
-    agent.load_weights("2048_weights.pkl");
+    agent.attach_weights("2048_weights.bin", "2048_weights.pkl");
+    agent.replicate_weights_numa();
     Env2048 env;
     env.reset();
     bool done = false;
@@ -5,6 +5,12 @@ labels = ['Sequential', 'Strategy 1', 'Strategy 2 w. 4 threads', 'Strategy 2 w.
 x = np.arange(len(labels))   # [0,1,2]
 width = 0.35
 
+# Average time of the first 100 moves of expectimax_search/Expectimax.exe with
+# --samples 20 --table 0 --depth 3 (or 5) and, per bar:
+#   --strategy sequential
+#   --strategy root --threads 4
+#   --strategy two-level --threads 4
+#   --strategy two-level --threads 11
 speedup_d3 = [1, 1.831720135, 2.1278, 2.701581343]
 speedup_d5 = [1, 2.659, 2.82627, 4.1124]
 